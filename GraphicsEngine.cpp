@@ -4,8 +4,25 @@
 #include <fstream>
 #include <strstream>
 #include <algorithm>
+#include <map>
+#include <unordered_map>
+#include <list>
+#include <queue>
+#include <tuple>
+#include <array>
+#include <thread>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <future>
+#include <deque>
 #include <math.h>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define GRAPHICS_ENGINE_SSE2
+#include <emmintrin.h>
+#endif
+
 struct Vector3d { //struct defining vector in 3d space, determined by xyz coords
     float x, y, z;
     //vector3d(float x, float y, float z) : x(x), y(y), z(z) { }
@@ -14,20 +31,245 @@ struct Vector3d { //struct defining vector in 3d space, determined by xyz coords
 struct Triangle { //struct defining a triangle, which is made of 3 vertices
     Vector3d points[3];
     olc::Pixel color;
+    olc::Pixel colors[3]; //lit colour per vertex, for gouraud shading
+    Vector3d normals[3]; //view space normal per vertex, for phong shading
     //triangle(vector3d a, vector3d b, vector3d c) : points{ a, b, c } { }
 };
 
+struct MeshCluster { //struct defining a run of nearby triangles in an index buffer that get culled as one
+    int firstIndex = 0;
+    int indexCount = 0;
+    Vector3d center = { 0, 0, 0 };
+    float radius = 0.0f;
+    Vector3d coneAxis = { 0, 0, 0 }; //average facing of the triangles, the whole cluster is back facing when the camera sits inside the cone behind it
+    float coneCutoff = 1.0f;
+};
+
+struct MeshLevelOfDetail { //struct defining one level of detail, an index buffer into the vertices shared by every level
+    std::vector<int> indices;
+    float error = 0.0f; //how far, in object space, this level may deviate from the full detail surface
+    std::vector<MeshCluster> clusters;
+    std::vector<Vector3d> faceNormals; //unit object space normal per triangle, so frames only rotate them
+};
+
+struct Quadric { //struct defining a symmetric 4x4 error quadric, stored as its 10 unique coefficients
+    double q[10] = { 0 };
+
+    void AddPlane(double a, double b, double c, double d, double weight = 1.0) {
+        q[0] += weight * a * a; q[1] += weight * a * b; q[2] += weight * a * c; q[3] += weight * a * d;
+        q[4] += weight * b * b; q[5] += weight * b * c; q[6] += weight * b * d;
+        q[7] += weight * c * c; q[8] += weight * c * d;
+        q[9] += weight * d * d;
+    }
+
+    void Add(const Quadric& other) {
+        for (int i = 0; i < 10; i++)
+            q[i] += other.q[i];
+    }
+
+    //sum of squared distances from the point to every plane accumulated into the quadric
+    double Evaluate(const Vector3d& v) const {
+        double x = v.x, y = v.y, z = v.z;
+        return q[0] * x * x + 2 * q[1] * x * y + 2 * q[2] * x * z + 2 * q[3] * x
+            + q[4] * y * y + 2 * q[5] * y * z + 2 * q[6] * y
+            + q[7] * z * z + 2 * q[8] * z
+            + q[9];
+    }
+};
+
+//quadric error metric simplifier from Garland & Heckbert, https://www.cs.cmu.edu/~./garland/Papers/quadrics.pdf
+//edges are collapsed onto one of their endpoints, so every level keeps indexing the same vertex array
+class MeshSimplifier {
+
+private:
+    struct Collapse {
+        double cost;
+        int from, to;
+        unsigned int fromStamp, toStamp;
+        bool operator>(const Collapse& other) const { return cost > other.cost; }
+    };
+
+    const std::vector<Vector3d>& vertices;
+    std::vector<int> indices;
+    std::vector<bool> triangleRemoved;
+    std::vector<Quadric> quadrics;
+    std::vector<std::vector<int>> vertexTriangles;
+    std::vector<unsigned int> stamps;
+    std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> collapses;
+
+    static Vector3d FaceNormal(const Vector3d& a, const Vector3d& b, const Vector3d& c) {
+        Vector3d line1 = { b.x - a.x, b.y - a.y, b.z - a.z };
+        Vector3d line2 = { c.x - a.x, c.y - a.y, c.z - a.z };
+        return { line1.y * line2.z - line1.z * line2.y, line1.z * line2.x - line1.x * line2.z, line1.x * line2.y - line1.y * line2.x };
+    }
+
+    void PushCollapse(int a, int b) {
+        Quadric combined = quadrics[a];
+        combined.Add(quadrics[b]);
+        double costToA = combined.Evaluate(vertices[a]);
+        double costToB = combined.Evaluate(vertices[b]);
+        if (costToB <= costToA)
+            collapses.push({ costToB, a, b, stamps[a], stamps[b] });
+        else
+            collapses.push({ costToA, b, a, stamps[b], stamps[a] });
+    }
+
+    //rejects collapses that would turn a surviving triangle around
+    bool CollapseFlipsTriangle(int from, int to) {
+        for (int t : vertexTriangles[from]) {
+            if (triangleRemoved[t])
+                continue;
+            int* tri = &indices[t * 3];
+            if (tri[0] == to || tri[1] == to || tri[2] == to)
+                continue;
+
+            Vector3d before = FaceNormal(vertices[tri[0]], vertices[tri[1]], vertices[tri[2]]);
+            Vector3d moved[3];
+            for (int i = 0; i < 3; i++)
+                moved[i] = vertices[tri[i] == from ? to : tri[i]];
+            Vector3d after = FaceNormal(moved[0], moved[1], moved[2]);
+
+            if (before.x * after.x + before.y * after.y + before.z * after.z <= 0.0f)
+                return true;
+        }
+        return false;
+    }
+
+public:
+    MeshSimplifier(const std::vector<Vector3d>& vertices, const std::vector<int>& indices) : vertices(vertices), indices(indices) {
+        triangleRemoved.assign(indices.size() / 3, false);
+        quadrics.resize(vertices.size());
+        vertexTriangles.resize(vertices.size());
+        stamps.assign(vertices.size(), 0);
+
+        std::map<std::pair<int, int>, int> edgeUses;
+        for (size_t t = 0; t < indices.size() / 3; t++) {
+            const int* tri = &indices[t * 3];
+            Vector3d normal = FaceNormal(vertices[tri[0]], vertices[tri[1]], vertices[tri[2]]);
+            float length = sqrtf(normal.x * normal.x + normal.y * normal.y + normal.z * normal.z);
+            if (length == 0.0f) {
+                triangleRemoved[t] = true;
+                continue;
+            }
+            normal = { normal.x / length, normal.y / length, normal.z / length };
+            double d = -(normal.x * vertices[tri[0]].x + normal.y * vertices[tri[0]].y + normal.z * vertices[tri[0]].z);
+
+            for (int i = 0; i < 3; i++) {
+                quadrics[tri[i]].AddPlane(normal.x, normal.y, normal.z, d);
+                vertexTriangles[tri[i]].push_back((int)t);
+                edgeUses[{ std::min(tri[i], tri[(i + 1) % 3]), std::max(tri[i], tri[(i + 1) % 3]) }]++;
+            }
+        }
+
+        //open edges get a heavily weighted plane perpendicular to their face so silhouettes hold their shape
+        for (size_t t = 0; t < indices.size() / 3; t++) {
+            if (triangleRemoved[t])
+                continue;
+            const int* tri = &indices[t * 3];
+            Vector3d normal = FaceNormal(vertices[tri[0]], vertices[tri[1]], vertices[tri[2]]);
+            for (int i = 0; i < 3; i++) {
+                int a = tri[i], b = tri[(i + 1) % 3];
+                if (edgeUses[{ std::min(a, b), std::max(a, b) }] != 1)
+                    continue;
+
+                Vector3d edge = { vertices[b].x - vertices[a].x, vertices[b].y - vertices[a].y, vertices[b].z - vertices[a].z };
+                Vector3d side = { edge.y * normal.z - edge.z * normal.y, edge.z * normal.x - edge.x * normal.z, edge.x * normal.y - edge.y * normal.x };
+                float length = sqrtf(side.x * side.x + side.y * side.y + side.z * side.z);
+                if (length == 0.0f)
+                    continue;
+                side = { side.x / length, side.y / length, side.z / length };
+                double d = -(side.x * vertices[a].x + side.y * vertices[a].y + side.z * vertices[a].z);
+                quadrics[a].AddPlane(side.x, side.y, side.z, d, 1000.0);
+                quadrics[b].AddPlane(side.x, side.y, side.z, d, 1000.0);
+            }
+        }
+
+        for (auto& edge : edgeUses)
+            PushCollapse(edge.first.first, edge.first.second);
+    }
+
+    //collapses the cheapest edges until the triangle count reaches the target, returns the remaining index buffer
+    std::vector<int> Simplify(size_t targetTriangles, float& error) {
+        size_t liveTriangles = std::count(triangleRemoved.begin(), triangleRemoved.end(), false);
+        double worstCost = 0.0;
+
+        while (liveTriangles > targetTriangles && !collapses.empty()) {
+            Collapse collapse = collapses.top();
+            collapses.pop();
+
+            if (collapse.fromStamp != stamps[collapse.from] || collapse.toStamp != stamps[collapse.to])
+                continue;
+            if (CollapseFlipsTriangle(collapse.from, collapse.to))
+                continue;
+
+            for (int t : vertexTriangles[collapse.from]) {
+                if (triangleRemoved[t])
+                    continue;
+                int* tri = &indices[t * 3];
+                if (tri[0] == collapse.to || tri[1] == collapse.to || tri[2] == collapse.to) {
+                    triangleRemoved[t] = true;
+                    liveTriangles--;
+                    continue;
+                }
+                for (int i = 0; i < 3; i++) {
+                    if (tri[i] == collapse.from)
+                        tri[i] = collapse.to;
+                }
+                vertexTriangles[collapse.to].push_back(t);
+            }
+
+            quadrics[collapse.to].Add(quadrics[collapse.from]);
+            vertexTriangles[collapse.from].clear();
+            stamps[collapse.from]++;
+            stamps[collapse.to]++;
+            worstCost = std::max(worstCost, collapse.cost);
+
+            for (int t : vertexTriangles[collapse.to]) {
+                if (triangleRemoved[t])
+                    continue;
+                for (int i = 0; i < 3; i++) {
+                    if (indices[t * 3 + i] != collapse.to)
+                        PushCollapse(collapse.to, indices[t * 3 + i]);
+                }
+            }
+        }
+
+        error = (float)sqrt(worstCost);
+
+        std::vector<int> simplified;
+        simplified.reserve(liveTriangles * 3);
+        for (size_t t = 0; t < triangleRemoved.size(); t++) {
+            if (!triangleRemoved[t])
+                simplified.insert(simplified.end(), indices.begin() + t * 3, indices.begin() + t * 3 + 3);
+        }
+        return simplified;
+    }
+};
+
 struct Mesh { //struct defining mesh, which is collection of triangles
     std::vector<Triangle> triangles;
 
+    //indexed copy of the triangles, level 0 is full detail and every further level roughly halves the triangle count
+    std::vector<Vector3d> vertices;
+    std::vector<Vector3d> vertexNormals; //area weighted average of the full detail faces around each vertex
+    std::vector<MeshLevelOfDetail> levelsOfDetail;
+    Vector3d boundsMin = { 0, 0, 0 }, boundsMax = { 0, 0, 0 };
+    Vector3d boundsCenter = { 0, 0, 0 };
+    float boundsRadius = 0.0f;
+
     bool LoadObjectFromFile(std::string sFilename)
     {
         std::ifstream f(sFilename);
         if (!f.is_open())
             return false;
+        return LoadObjectFromStream(f);
+    }
 
+    bool LoadObjectFromStream(std::istream& f)
+    {
         // Local cache of verts
         std::vector<Vector3d> verts;
+        std::vector<int> indices;
 
         while (!f.eof())
         {
@@ -51,218 +293,3070 @@ struct Mesh { //struct defining mesh, which is collection of triangles
                 int f[3];
                 s >> junk >> f[0] >> f[1] >> f[2];
                 triangles.push_back({ verts[f[0] - 1], verts[f[1] - 1], verts[f[2] - 1] });
+                indices.insert(indices.end(), { f[0] - 1, f[1] - 1, f[2] - 1 });
             }
         }
 
+        vertices = verts;
+        levelsOfDetail.clear();
+        levelsOfDetail.push_back({ indices, 0.0f });
+        BuildLevelsOfDetail();
         return true;
     }
+
+    //welds the triangle list into vertices/indices, for meshes filled in by hand instead of loaded
+    void BuildIndexedVertices() {
+        std::map<std::tuple<float, float, float>, int> vertexLookup;
+        MeshLevelOfDetail fullDetail;
+
+        vertices.clear();
+        for (auto& triangle : triangles) {
+            for (int i = 0; i < 3; i++) {
+                auto key = std::make_tuple(triangle.points[i].x, triangle.points[i].y, triangle.points[i].z);
+                auto found = vertexLookup.find(key);
+                if (found == vertexLookup.end()) {
+                    found = vertexLookup.emplace(key, (int)vertices.size()).first;
+                    vertices.push_back(triangle.points[i]);
+                }
+                fullDetail.indices.push_back(found->second);
+            }
+        }
+
+        levelsOfDetail.clear();
+        levelsOfDetail.push_back(fullDetail);
+    }
+
+    //builds the chain of simplified index buffers, each level keeping roughly "reduction" of the one before it
+    void BuildLevelsOfDetail(int maxLevels = 8, float reduction = 0.5f, size_t minTriangles = 32) {
+        if (levelsOfDetail.empty())
+            BuildIndexedVertices();
+        levelsOfDetail.resize(1);
+
+        boundsMin = { INFINITY, INFINITY, INFINITY };
+        boundsMax = { -INFINITY, -INFINITY, -INFINITY };
+        for (auto& v : vertices) {
+            boundsMin = { std::min(boundsMin.x, v.x), std::min(boundsMin.y, v.y), std::min(boundsMin.z, v.z) };
+            boundsMax = { std::max(boundsMax.x, v.x), std::max(boundsMax.y, v.y), std::max(boundsMax.z, v.z) };
+        }
+        boundsCenter = { (boundsMin.x + boundsMax.x) * 0.5f, (boundsMin.y + boundsMax.y) * 0.5f, (boundsMin.z + boundsMax.z) * 0.5f };
+        boundsRadius = 0.0f;
+        for (auto& v : vertices) {
+            float dx = v.x - boundsCenter.x, dy = v.y - boundsCenter.y, dz = v.z - boundsCenter.z;
+            boundsRadius = std::max(boundsRadius, sqrtf(dx * dx + dy * dy + dz * dz));
+        }
+
+        for (int level = 1; level < maxLevels; level++) {
+            const MeshLevelOfDetail& previous = levelsOfDetail.back();
+            size_t previousTriangles = previous.indices.size() / 3;
+            size_t targetTriangles = (size_t)(previousTriangles * reduction);
+            if (targetTriangles < minTriangles)
+                break;
+
+            MeshLevelOfDetail next;
+            float stepError = 0.0f;
+            next.indices = MeshSimplifier(vertices, previous.indices).Simplify(targetTriangles, stepError);
+            next.error = previous.error + stepError;
+
+            //stop once collapses start getting rejected and the mesh won't shrink any further
+            if (next.indices.size() / 3 >= previousTriangles * (1.0f + reduction) * 0.5f)
+                break;
+            levelsOfDetail.push_back(std::move(next));
+        }
+
+        for (auto& levelOfDetail : levelsOfDetail) {
+            BuildClusters(levelOfDetail, boundsMin, boundsMax);
+            BuildFaceNormals(levelOfDetail);
+        }
+        BuildVertexNormals();
+    }
+
+    void BuildFaceNormals(MeshLevelOfDetail& levelOfDetail) {
+        levelOfDetail.faceNormals.resize(levelOfDetail.indices.size() / 3);
+        for (size_t t = 0; t < levelOfDetail.faceNormals.size(); t++) {
+            const Vector3d& a = vertices[levelOfDetail.indices[t * 3]];
+            const Vector3d& b = vertices[levelOfDetail.indices[t * 3 + 1]];
+            const Vector3d& c = vertices[levelOfDetail.indices[t * 3 + 2]];
+            Vector3d line1 = { b.x - a.x, b.y - a.y, b.z - a.z };
+            Vector3d line2 = { c.x - a.x, c.y - a.y, c.z - a.z };
+            Vector3d normal = { line1.y * line2.z - line1.z * line2.y, line1.z * line2.x - line1.x * line2.z, line1.x * line2.y - line1.y * line2.x };
+            float length = sqrtf(normal.x * normal.x + normal.y * normal.y + normal.z * normal.z);
+            levelOfDetail.faceNormals[t] = length > 0.0f ? Vector3d{ normal.x / length, normal.y / length, normal.z / length } : Vector3d{ 0, 0, 0 };
+        }
+    }
+
+    //the unnormalized cross product is twice the face area, so summing it weights every face by its size
+    void BuildVertexNormals() {
+        vertexNormals.assign(vertices.size(), { 0, 0, 0 });
+        const std::vector<int>& indices = levelsOfDetail[0].indices;
+        for (size_t i = 0; i < indices.size(); i += 3) {
+            const Vector3d& a = vertices[indices[i]];
+            const Vector3d& b = vertices[indices[i + 1]];
+            const Vector3d& c = vertices[indices[i + 2]];
+            Vector3d line1 = { b.x - a.x, b.y - a.y, b.z - a.z };
+            Vector3d line2 = { c.x - a.x, c.y - a.y, c.z - a.z };
+            Vector3d normal = { line1.y * line2.z - line1.z * line2.y, line1.z * line2.x - line1.x * line2.z, line1.x * line2.y - line1.y * line2.x };
+            for (int j = 0; j < 3; j++) {
+                Vector3d& sum = vertexNormals[indices[i + j]];
+                sum = { sum.x + normal.x, sum.y + normal.y, sum.z + normal.z };
+            }
+        }
+
+        for (auto& normal : vertexNormals) {
+            float length = sqrtf(normal.x * normal.x + normal.y * normal.y + normal.z * normal.z);
+            if (length > 0.0f)
+                normal = { normal.x / length, normal.y / length, normal.z / length };
+        }
+    }
+
+    //reorders the triangles along a morton curve so neighbours end up together, then cuts them into clusters
+    void BuildClusters(MeshLevelOfDetail& levelOfDetail, const Vector3d& boundsMin, const Vector3d& boundsMax, int trianglesPerCluster = 64) {
+        auto spread = [](uint32_t v) {
+            v = (v | (v << 16)) & 0x030000FF;
+            v = (v | (v << 8)) & 0x0300F00F;
+            v = (v | (v << 4)) & 0x030C30C3;
+            v = (v | (v << 2)) & 0x09249249;
+            return v;
+        };
+        auto quantize = [](float v, float lo, float hi) {
+            return (uint32_t)(hi > lo ? std::min(1023.0f, (v - lo) / (hi - lo) * 1023.0f) : 0.0f);
+        };
+
+        std::vector<int>& indices = levelOfDetail.indices;
+        size_t triangleCount = indices.size() / 3;
+        std::vector<std::pair<uint32_t, int>> order(triangleCount);
+        for (size_t t = 0; t < triangleCount; t++) {
+            const Vector3d& a = vertices[indices[t * 3]];
+            const Vector3d& b = vertices[indices[t * 3 + 1]];
+            const Vector3d& c = vertices[indices[t * 3 + 2]];
+            uint32_t x = quantize((a.x + b.x + c.x) / 3.0f, boundsMin.x, boundsMax.x);
+            uint32_t y = quantize((a.y + b.y + c.y) / 3.0f, boundsMin.y, boundsMax.y);
+            uint32_t z = quantize((a.z + b.z + c.z) / 3.0f, boundsMin.z, boundsMax.z);
+            order[t] = { spread(x) | (spread(y) << 1) | (spread(z) << 2), (int)t };
+        }
+        std::sort(order.begin(), order.end());
+
+        std::vector<int> sorted(indices.size());
+        for (size_t t = 0; t < triangleCount; t++) {
+            for (int i = 0; i < 3; i++)
+                sorted[t * 3 + i] = indices[order[t].second * 3 + i];
+        }
+        indices.swap(sorted);
+
+        levelOfDetail.clusters.clear();
+        for (size_t first = 0; first < triangleCount; first += trianglesPerCluster) {
+            MeshCluster cluster;
+            cluster.firstIndex = (int)first * 3;
+            cluster.indexCount = (int)std::min((size_t)trianglesPerCluster, triangleCount - first) * 3;
+
+            Vector3d clusterMin = { INFINITY, INFINITY, INFINITY }, clusterMax = { -INFINITY, -INFINITY, -INFINITY };
+            std::vector<Vector3d> normals;
+            for (int i = cluster.firstIndex; i < cluster.firstIndex + cluster.indexCount; i += 3) {
+                const Vector3d& a = vertices[indices[i]];
+                const Vector3d& b = vertices[indices[i + 1]];
+                const Vector3d& c = vertices[indices[i + 2]];
+                for (const Vector3d* v : { &a, &b, &c }) {
+                    clusterMin = { std::min(clusterMin.x, v->x), std::min(clusterMin.y, v->y), std::min(clusterMin.z, v->z) };
+                    clusterMax = { std::max(clusterMax.x, v->x), std::max(clusterMax.y, v->y), std::max(clusterMax.z, v->z) };
+                }
+
+                Vector3d line1 = { b.x - a.x, b.y - a.y, b.z - a.z };
+                Vector3d line2 = { c.x - a.x, c.y - a.y, c.z - a.z };
+                Vector3d normal = { line1.y * line2.z - line1.z * line2.y, line1.z * line2.x - line1.x * line2.z, line1.x * line2.y - line1.y * line2.x };
+                float length = sqrtf(normal.x * normal.x + normal.y * normal.y + normal.z * normal.z);
+                if (length > 0.0f)
+                    normals.push_back({ normal.x / length, normal.y / length, normal.z / length });
+            }
+
+            cluster.center = { (clusterMin.x + clusterMax.x) * 0.5f, (clusterMin.y + clusterMax.y) * 0.5f, (clusterMin.z + clusterMax.z) * 0.5f };
+            for (int i = cluster.firstIndex; i < cluster.firstIndex + cluster.indexCount; i++) {
+                const Vector3d& v = vertices[indices[i]];
+                float dx = v.x - cluster.center.x, dy = v.y - cluster.center.y, dz = v.z - cluster.center.z;
+                cluster.radius = std::max(cluster.radius, sqrtf(dx * dx + dy * dy + dz * dz));
+            }
+
+            //normal cone from https://github.com/zeux/meshoptimizer, a cutoff of 1 means the cone is too wide to ever cull
+            Vector3d axis = { 0, 0, 0 };
+            for (auto& normal : normals)
+                axis = { axis.x + normal.x, axis.y + normal.y, axis.z + normal.z };
+            float axisLength = sqrtf(axis.x * axis.x + axis.y * axis.y + axis.z * axis.z);
+            if (axisLength > 0.0f) {
+                axis = { axis.x / axisLength, axis.y / axisLength, axis.z / axisLength };
+                float minimumDot = 1.0f;
+                for (auto& normal : normals)
+                    minimumDot = std::min(minimumDot, axis.x * normal.x + axis.y * normal.y + axis.z * normal.z);
+                cluster.coneAxis = axis;
+                cluster.coneCutoff = minimumDot > 0.0f ? sqrtf(1.0f - minimumDot * minimumDot) : 1.0f;
+            }
+
+            levelOfDetail.clusters.push_back(cluster);
+        }
+    }
 };
 
 struct Matrix4x4 {
     float matrix[4][4] = { 0 };
 };
 
-class GrahpicsEngine : public olc::PixelGameEngine {
+//matrices are applied to row vectors (v * M), so MultiplyMatrices(a, b) applies a first and then b
+Matrix4x4 MultiplyMatrices(const Matrix4x4& a, const Matrix4x4& b) {
+    Matrix4x4 result;
+    for (int row = 0; row < 4; row++) {
+        for (int column = 0; column < 4; column++) {
+            result.matrix[row][column] = a.matrix[row][0] * b.matrix[0][column] + a.matrix[row][1] * b.matrix[1][column] +
+                a.matrix[row][2] * b.matrix[2][column] + a.matrix[row][3] * b.matrix[3][column];
+        }
+    }
+    return result;
+}
 
-private:
-    Mesh meshCube;
-    Matrix4x4 projectionMatrix;
-    float theta = 0.0f;
+Matrix4x4 MakeIdentityMatrix() {
+    Matrix4x4 identityMatrix;
+    for (int i = 0; i < 4; i++)
+        identityMatrix.matrix[i][i] = 1.0f;
+    return identityMatrix;
+}
 
-    Vector3d camera;
+Matrix4x4 MakeTranslationMatrix(float x, float y, float z) {
+    Matrix4x4 translationMatrix = MakeIdentityMatrix();
+    translationMatrix.matrix[3][0] = x;
+    translationMatrix.matrix[3][1] = y;
+    translationMatrix.matrix[3][2] = z;
+    return translationMatrix;
+}
 
-    void MultiplyVectorByMatrix(Vector3d& input_vector, Vector3d& output_vector, Matrix4x4& matrix) {
-        output_vector.x = input_vector.x * matrix.matrix[0][0] + input_vector.y * matrix.matrix[1][0] + input_vector.z * matrix.matrix[2][0] + matrix.matrix[3][0];
-        output_vector.y = input_vector.x * matrix.matrix[0][1] + input_vector.y * matrix.matrix[1][1] + input_vector.z * matrix.matrix[2][1] + matrix.matrix[3][1];
-        output_vector.z = input_vector.x * matrix.matrix[0][2] + input_vector.y * matrix.matrix[1][2] + input_vector.z * matrix.matrix[2][2] + matrix.matrix[3][2];
-        float w = input_vector.x * matrix.matrix[0][3] + input_vector.y * matrix.matrix[1][3] + input_vector.z * matrix.matrix[2][3] + matrix.matrix[3][3];
+//rotation matrices from https://en.wikipedia.org/wiki/Rotation_matrix#:~:text=in%20its%20center.-,Basic%203D%20rotations,-%5Bedit%5D
+Matrix4x4 MakeRotationMatrixX(float theta) {
+    Matrix4x4 rotationMatrixX;
 
-        if (w != 0) {
-            output_vector.x /= w;
-            output_vector.y /= w;
-            output_vector.z /= w;
+    rotationMatrixX.matrix[0][0] = 1;
+    rotationMatrixX.matrix[1][1] = -cosf(theta);
+    rotationMatrixX.matrix[1][2] = sinf(theta);
+    rotationMatrixX.matrix[2][1] = -sinf(theta);
+    rotationMatrixX.matrix[2][2] = -cosf(theta);
+    rotationMatrixX.matrix[3][3] = 1;
+
+    return rotationMatrixX;
+}
+
+Matrix4x4 MakeRotationMatrixY(float theta) {
+    Matrix4x4 rotationMatrixY;
+
+    rotationMatrixY.matrix[0][0] = cosf(theta);
+    rotationMatrixY.matrix[0][2] = -sinf(theta);
+    rotationMatrixY.matrix[1][1] = 1;
+    rotationMatrixY.matrix[2][0] = sinf(theta);
+    rotationMatrixY.matrix[2][2] = cosf(theta);
+    rotationMatrixY.matrix[3][3] = 1;
+
+    return rotationMatrixY;
+}
+
+Matrix4x4 MakeRotationMatrixZ(float theta) {
+    Matrix4x4 rotationMatrixZ;
+
+    rotationMatrixZ.matrix[0][0] = cosf(theta);
+    rotationMatrixZ.matrix[0][1] = sinf(theta);
+    rotationMatrixZ.matrix[1][0] = -sinf(theta);
+    rotationMatrixZ.matrix[1][1] = cosf(theta);
+    rotationMatrixZ.matrix[2][2] = 1;
+    rotationMatrixZ.matrix[3][3] = 1;
+
+    return rotationMatrixZ;
+}
+
+//view matrix for an eye looking at the target, view space has x to the right of the screen, y down it and z into it
+Matrix4x4 MakeLookAtMatrix(const Vector3d& eye, const Vector3d& target, const Vector3d& up) {
+    Vector3d forward = { target.x - eye.x, target.y - eye.y, target.z - eye.z };
+    float length = sqrtf(forward.x * forward.x + forward.y * forward.y + forward.z * forward.z);
+    forward = { forward.x / length, forward.y / length, forward.z / length };
+
+    Vector3d right = { forward.y * up.z - forward.z * up.y, forward.z * up.x - forward.x * up.z, forward.x * up.y - forward.y * up.x };
+    length = sqrtf(right.x * right.x + right.y * right.y + right.z * right.z);
+    right = { right.x / length, right.y / length, right.z / length };
+
+    Vector3d down = { forward.y * right.z - forward.z * right.y, forward.z * right.x - forward.x * right.z, forward.x * right.y - forward.y * right.x };
+
+    Matrix4x4 lookAtMatrix;
+    const Vector3d* axes[3] = { &right, &down, &forward };
+    for (int column = 0; column < 3; column++) {
+        lookAtMatrix.matrix[0][column] = axes[column]->x;
+        lookAtMatrix.matrix[1][column] = axes[column]->y;
+        lookAtMatrix.matrix[2][column] = axes[column]->z;
+        lookAtMatrix.matrix[3][column] = -(axes[column]->x * eye.x + axes[column]->y * eye.y + axes[column]->z * eye.z);
+    }
+    lookAtMatrix.matrix[3][3] = 1.0f;
+
+    return lookAtMatrix;
+}
+
+//applies only the rotation and scale part of the matrix, for directions and normals
+Vector3d TransformDirection(const Vector3d& v, const Matrix4x4& m) {
+    return {
+        v.x * m.matrix[0][0] + v.y * m.matrix[1][0] + v.z * m.matrix[2][0],
+        v.x * m.matrix[0][1] + v.y * m.matrix[1][1] + v.z * m.matrix[2][1],
+        v.x * m.matrix[0][2] + v.y * m.matrix[1][2] + v.z * m.matrix[2][2]
+    };
+}
+
+//inverse of a matrix made from rotations, scales and translations, the last column is assumed to be 0, 0, 0, 1
+Matrix4x4 InvertAffineMatrix(const Matrix4x4& m) {
+    const float (*a)[4] = m.matrix;
+    float determinant = a[0][0] * (a[1][1] * a[2][2] - a[1][2] * a[2][1])
+        - a[0][1] * (a[1][0] * a[2][2] - a[1][2] * a[2][0])
+        + a[0][2] * (a[1][0] * a[2][1] - a[1][1] * a[2][0]);
+    float inverseDeterminant = determinant != 0.0f ? 1.0f / determinant : 0.0f;
+
+    Matrix4x4 inverse;
+    inverse.matrix[0][0] = (a[1][1] * a[2][2] - a[1][2] * a[2][1]) * inverseDeterminant;
+    inverse.matrix[0][1] = (a[0][2] * a[2][1] - a[0][1] * a[2][2]) * inverseDeterminant;
+    inverse.matrix[0][2] = (a[0][1] * a[1][2] - a[0][2] * a[1][1]) * inverseDeterminant;
+    inverse.matrix[1][0] = (a[1][2] * a[2][0] - a[1][0] * a[2][2]) * inverseDeterminant;
+    inverse.matrix[1][1] = (a[0][0] * a[2][2] - a[0][2] * a[2][0]) * inverseDeterminant;
+    inverse.matrix[1][2] = (a[0][2] * a[1][0] - a[0][0] * a[1][2]) * inverseDeterminant;
+    inverse.matrix[2][0] = (a[1][0] * a[2][1] - a[1][1] * a[2][0]) * inverseDeterminant;
+    inverse.matrix[2][1] = (a[0][1] * a[2][0] - a[0][0] * a[2][1]) * inverseDeterminant;
+    inverse.matrix[2][2] = (a[0][0] * a[1][1] - a[0][1] * a[1][0]) * inverseDeterminant;
+
+    for (int column = 0; column < 3; column++) {
+        inverse.matrix[3][column] = -(a[3][0] * inverse.matrix[0][column] + a[3][1] * inverse.matrix[1][column] + a[3][2] * inverse.matrix[2][column]);
+    }
+    inverse.matrix[3][3] = 1.0f;
+    return inverse;
+}
+
+//clips a view space triangle to z >= nearZ, interpolating positions and normals, and returns how many triangles are left
+//crossings take the slot of the vertex they replace, so the winding never changes
+int ClipTriangleToNearPlane(const Triangle& triangle, float nearZ, Triangle (&clipped)[2]) {
+    int inside[3], outside[3], insideCount = 0, outsideCount = 0;
+    for (int i = 0; i < 3; i++) {
+        if (triangle.points[i].z >= nearZ)
+            inside[insideCount++] = i;
+        else
+            outside[outsideCount++] = i;
+    }
+    if (insideCount == 0)
+        return 0;
+
+    clipped[0] = triangle;
+    if (insideCount == 3)
+        return 1;
+
+    auto crossing = [&](int from, int to, Triangle& target, int slot) {
+        const Vector3d& a = triangle.points[from], & b = triangle.points[to];
+        const Vector3d& na = triangle.normals[from], & nb = triangle.normals[to];
+        float t = (nearZ - a.z) / (b.z - a.z);
+        target.points[slot] = { a.x + (b.x - a.x) * t, a.y + (b.y - a.y) * t, nearZ };
+        target.normals[slot] = { na.x + (nb.x - na.x) * t, na.y + (nb.y - na.y) * t, na.z + (nb.z - na.z) * t };
+    };
+
+    if (insideCount == 1) {
+        crossing(inside[0], outside[0], clipped[0], outside[0]);
+        crossing(inside[0], outside[1], clipped[0], outside[1]);
+        return 1;
+    }
+
+    //two vertices inside leave a quad, split along the first crossing
+    clipped[1] = triangle;
+    crossing(inside[0], outside[0], clipped[0], outside[0]);
+    crossing(inside[1], outside[0], clipped[1], outside[0]);
+    crossing(inside[0], outside[0], clipped[1], inside[0]);
+    return 2;
+}
+
+struct Plane { //struct defining a plane as the points p where dot(normal, p) + distance = 0
+    Vector3d normal;
+    float distance;
+};
+
+struct Frustum { //struct defining the six planes bounding what the camera can see, normals pointing inwards
+    Plane planes[6];
+
+    //planes from Gribb & Hartmann, https://www.gamedevs.org/uploads/fast-extraction-viewing-frustum-planes-from-world-view-projection-matrix.pdf
+    //written for row vectors, so each plane is built from columns of the matrix rather than rows
+    static Frustum FromMatrix(const Matrix4x4& m) {
+        Frustum frustum;
+        auto column = [&m](int c, float sign, int plane, Frustum& f) {
+            f.planes[plane].normal = { m.matrix[0][3] + sign * m.matrix[0][c], m.matrix[1][3] + sign * m.matrix[1][c], m.matrix[2][3] + sign * m.matrix[2][c] };
+            f.planes[plane].distance = m.matrix[3][3] + sign * m.matrix[3][c];
+        };
+        column(0, 1.0f, 0, frustum);  //left
+        column(0, -1.0f, 1, frustum); //right
+        column(1, 1.0f, 2, frustum);  //bottom
+        column(1, -1.0f, 3, frustum); //top
+        column(2, -1.0f, 5, frustum); //far
+        frustum.planes[4].normal = { m.matrix[0][2], m.matrix[1][2], m.matrix[2][2] }; //near, depth runs 0 to w
+        frustum.planes[4].distance = m.matrix[3][2];
+
+        for (auto& plane : frustum.planes) {
+            float length = sqrtf(plane.normal.x * plane.normal.x + plane.normal.y * plane.normal.y + plane.normal.z * plane.normal.z);
+            plane.normal = { plane.normal.x / length, plane.normal.y / length, plane.normal.z / length };
+            plane.distance /= length;
         }
+        return frustum;
     }
 
-    void ScaleTriangleToScreen(Triangle& triangle) {
-        for (int i = 0; i < 3; i++) {
-            triangle.points[i].x += 1.0f;
-            triangle.points[i].y += 1.0f;
-            triangle.points[i].x *= 0.5f * (float)ScreenWidth();
-            triangle.points[i].y *= 0.5f * (float)ScreenHeight();
+    enum class Containment { OUTSIDE, INTERSECTING, INSIDE };
+
+    //tests the box corner furthest along each plane normal, and the nearest one to tell apart fully inside
+    Containment TestBox(const Vector3d& boxMin, const Vector3d& boxMax) const {
+        Containment result = Containment::INSIDE;
+        for (auto& plane : planes) {
+            Vector3d furthest = { plane.normal.x >= 0 ? boxMax.x : boxMin.x, plane.normal.y >= 0 ? boxMax.y : boxMin.y, plane.normal.z >= 0 ? boxMax.z : boxMin.z };
+            Vector3d nearest = { plane.normal.x >= 0 ? boxMin.x : boxMax.x, plane.normal.y >= 0 ? boxMin.y : boxMax.y, plane.normal.z >= 0 ? boxMin.z : boxMax.z };
+            if (plane.normal.x * furthest.x + plane.normal.y * furthest.y + plane.normal.z * furthest.z + plane.distance < 0)
+                return Containment::OUTSIDE;
+            if (plane.normal.x * nearest.x + plane.normal.y * nearest.y + plane.normal.z * nearest.z + plane.distance < 0)
+                result = Containment::INTERSECTING;
         }
+        return result;
     }
 
-    void NormalizeVector(Vector3d& input_vector) {
-        float length = sqrtf(input_vector.x * input_vector.x + input_vector.y * input_vector.y + input_vector.z * input_vector.z);
-        input_vector.x /= length;
-        input_vector.y /= length;
-        input_vector.z /= length;
+    bool IsSphereVisible(const Vector3d& center, float radius) const {
+        for (auto& plane : planes) {
+            if (plane.normal.x * center.x + plane.normal.y * center.y + plane.normal.z * center.z + plane.distance < -radius)
+                return false;
+        }
+        return true;
     }
+};
 
-    olc::Pixel GetShadeFromLumosity(float lumosity)
-    {
-        olc::Pixel shadedColor = olc::PixelF(lumosity, lumosity, lumosity);
-        return shadedColor;
+class Camera { //class defining where the scene is viewed from, turned by yaw and pitch only so it never rolls
+
+public:
+    Vector3d position = { 0, 0, 0 };
+    float yaw = 0.0f; //radians about the vertical axis, 0 looks along +z
+    float pitch = 0.0f; //radians, positive looks up
+    float moveSpeed = 2.0f; //units per second
+    float turnSpeed = 1.5f; //radians per second
+    float mouseSensitivity = 0.005f; //radians per pixel the mouse moves
+
+    //y points down the screen, so up in the world is -y
+    static constexpr Vector3d worldUp = { 0.0f, -1.0f, 0.0f };
+
+    Vector3d GetForward() const {
+        return { sinf(yaw) * cosf(pitch), -sinf(pitch), cosf(yaw) * cosf(pitch) };
     }
 
-    //rotation matrices from https://en.wikipedia.org/wiki/Rotation_matrix#:~:text=in%20its%20center.-,Basic%203D%20rotations,-%5Bedit%5D
-    void RotateObjectX(Triangle& input_triangle, Triangle& output_triangle, float theta) {
-        Matrix4x4 rotationMatrixX;
+    Vector3d GetRight() const {
+        return { cosf(yaw), 0.0f, -sinf(yaw) };
+    }
 
-        rotationMatrixX.matrix[0][0] = 1;
-        rotationMatrixX.matrix[1][1] = -cosf(theta);
-        rotationMatrixX.matrix[1][2] = sinf(theta);
-        rotationMatrixX.matrix[2][1] = -sinf(theta);
-        rotationMatrixX.matrix[2][2] = -cosf(theta);
-        rotationMatrixX.matrix[3][3] = 1;
+    //forward and right stay level, so looking up or down doesn't change how walking feels
+    void Move(float forward, float right, float up) {
+        position.x += sinf(yaw) * forward + cosf(yaw) * right + worldUp.x * up;
+        position.y += worldUp.y * up;
+        position.z += cosf(yaw) * forward - sinf(yaw) * right + worldUp.z * up;
+    }
 
-        for (int i = 0; i < 3; i++) {
-            MultiplyVectorByMatrix(input_triangle.points[i], output_triangle.points[i], rotationMatrixX);
-        }
+    void Turn(float yawChange, float pitchChange) {
+        const float pitchLimit = 1.55f; //just short of straight up or down, where the look-at basis breaks down
+        yaw += yawChange;
+        pitch = std::max(-pitchLimit, std::min(pitchLimit, pitch + pitchChange));
     }
 
-    void RotateObjectY(Triangle& input_triangle, Triangle& output_triangle, float theta) {
-        Matrix4x4 rotationMatrixY;
+    void LookAt(const Vector3d& target) {
+        Vector3d direction = { target.x - position.x, target.y - position.y, target.z - position.z };
+        float length = sqrtf(direction.x * direction.x + direction.y * direction.y + direction.z * direction.z);
+        if (length == 0.0f)
+            return;
+        yaw = atan2f(direction.x, direction.z);
+        pitch = asinf(-direction.y / length);
+    }
 
-        rotationMatrixY.matrix[0][0] = cosf(theta);
-        rotationMatrixY.matrix[0][2] = -sinf(theta);
-        rotationMatrixY.matrix[1][1] = 1;
-        rotationMatrixY.matrix[2][0] = sinf(theta);
-        rotationMatrixY.matrix[2][2] = cosf(theta);
-        rotationMatrixY.matrix[3][3] = 1;
+    Matrix4x4 GetViewMatrix() const {
+        Vector3d forward = GetForward();
+        return MakeLookAtMatrix(position, { position.x + forward.x, position.y + forward.y, position.z + forward.z }, worldUp);
+    }
+};
 
-        for (int i = 0; i < 3; i++) {
-            MultiplyVectorByMatrix(input_triangle.points[i], output_triangle.points[i], rotationMatrixY);
+constexpr Vector3d Camera::worldUp; //out of class definition, MakeLookAtMatrix binds it by reference and C++14 needs the storage
+
+struct ShadeTable { //struct defining precomputed products of a quantized light level and a material channel, so shading is a lookup instead of float conversion and clamping
+    static constexpr int LEVELS = 512;
+    static constexpr float MAXIMUM_LIGHT = 2.0f; //light above this saturates, overlapping lights can still push a colour to white
+    std::vector<uint8_t> table;
+
+    ShadeTable() : table(LEVELS * 256) {
+        for (int level = 0; level < LEVELS; level++) {
+            float light = level * MAXIMUM_LIGHT / (LEVELS - 1);
+            for (int material = 0; material < 256; material++)
+                table[level * 256 + material] = (uint8_t)std::min(255.0f, light * material + 0.5f);
         }
     }
 
-    void RotateObjectZ(Triangle& input_triangle, Triangle& output_triangle, float theta) {
-        Matrix4x4 rotationMatrixZ;
+    static int Quantize(float light) {
+        return std::max(0, std::min(LEVELS - 1, (int)(light * ((LEVELS - 1) / MAXIMUM_LIGHT) + 0.5f)));
+    }
+
+    uint8_t Shade(int level, uint8_t material) const {
+        return table[level * 256 + material];
+    }
 
-        rotationMatrixZ.matrix[0][0] = cosf(theta);
-        rotationMatrixZ.matrix[0][1] = sinf(theta);
-        rotationMatrixZ.matrix[1][0] = -sinf(theta);
-        rotationMatrixZ.matrix[1][1] = cosf(theta);
-        rotationMatrixZ.matrix[2][2] = 1;
-        rotationMatrixZ.matrix[3][3] = 1;
+    olc::Pixel Shade(const Vector3d& light, olc::Pixel color) const {
+        return olc::Pixel(Shade(Quantize(light.x), color.r), Shade(Quantize(light.y), color.g), Shade(Quantize(light.z), color.b), color.a);
+    }
+};
 
-        for (int i = 0; i < 3; i++) {
-            MultiplyVectorByMatrix(input_triangle.points[i], output_triangle.points[i], rotationMatrixZ);
+struct Palette { //struct defining 256 colours for an 8 bit framebuffer and the inverse table that maps any colour onto its nearest entry
+    std::array<olc::Pixel, 256> colors;
+    std::vector<uint8_t> inverse; //nearest entry for every colour cut down to 5 bits per channel
+
+    //a 6x6x6 colour cube plus a 40 step grey ramp, the greys keep plain shaded materials from banding
+    Palette() {
+        int entry = 0;
+        for (int r = 0; r < 6; r++) {
+            for (int g = 0; g < 6; g++) {
+                for (int b = 0; b < 6; b++)
+                    colors[entry++] = olc::Pixel(r * 51, g * 51, b * 51);
+            }
         }
+        for (int grey = 0; entry < 256; grey++)
+            colors[entry++] = olc::Pixel((grey * 255 + 20) / 40, (grey * 255 + 20) / 40, (grey * 255 + 20) / 40);
+        BuildInverse();
     }
 
-public:
-    GrahpicsEngine() {
-        sAppName = "Cube Demo";
+    void SetColors(const std::array<olc::Pixel, 256>& newColors) {
+        colors = newColors;
+        BuildInverse();
     }
 
-    bool OnUserCreate() override {
-        /*meshCube.triangles = {
-        { 0.0f, 0.0f, 0.0f,    0.0f, 1.0f, 0.0f,    1.0f, 1.0f, 0.0f },
-        { 0.0f, 0.0f, 0.0f,    1.0f, 1.0f, 0.0f,    1.0f, 0.0f, 0.0f },                                                    
-        { 1.0f, 0.0f, 0.0f,    1.0f, 1.0f, 0.0f,    1.0f, 1.0f, 1.0f },
-        { 1.0f, 0.0f, 0.0f,    1.0f, 1.0f, 1.0f,    1.0f, 0.0f, 1.0f },                                                   
-        { 1.0f, 0.0f, 1.0f,    1.0f, 1.0f, 1.0f,    0.0f, 1.0f, 1.0f },
-        { 1.0f, 0.0f, 1.0f,    0.0f, 1.0f, 1.0f,    0.0f, 0.0f, 1.0f },                                                     
-        { 0.0f, 0.0f, 1.0f,    0.0f, 1.0f, 1.0f,    0.0f, 1.0f, 0.0f },
-        { 0.0f, 0.0f, 1.0f,    0.0f, 1.0f, 0.0f,    0.0f, 0.0f, 0.0f },                                                     
-        { 0.0f, 1.0f, 0.0f,    0.0f, 1.0f, 1.0f,    1.0f, 1.0f, 1.0f },
-        { 0.0f, 1.0f, 0.0f,    1.0f, 1.0f, 1.0f,    1.0f, 1.0f, 0.0f },                                                  
-        { 1.0f, 0.0f, 1.0f,    0.0f, 0.0f, 1.0f,    0.0f, 0.0f, 0.0f },
-        { 1.0f, 0.0f, 1.0f,    0.0f, 0.0f, 0.0f,    1.0f, 0.0f, 0.0f }
-        };*/
-
-        if (!meshCube.LoadObjectFromFile("peter_griffin.obj")) {
-            return false;
+    void BuildInverse() {
+        inverse.resize(32 * 32 * 32);
+        for (int key = 0; key < 32 * 32 * 32; key++) {
+            int r = ((key >> 10) & 31) * 255 / 31, g = ((key >> 5) & 31) * 255 / 31, b = (key & 31) * 255 / 31;
+            int best = 0, bestDistance = INT32_MAX;
+            for (int entry = 0; entry < 256; entry++) {
+                int dr = r - colors[entry].r, dg = g - colors[entry].g, db = b - colors[entry].b;
+                int distance = 3 * dr * dr + 4 * dg * dg + 2 * db * db; //rough perceptual weighting
+                if (distance < bestDistance) {
+                    bestDistance = distance;
+                    best = entry;
+                }
+            }
+            inverse[key] = (uint8_t)best;
         }
+    }
 
-        float zNear = 0.1f;
-        float zFar = 1000.0f;
-        float fieldOfView = 90.0f;
-        float aspectRatio = (float)ScreenHeight() / (float)ScreenWidth();
-        float fovRadians = 1.0f / tanf(fieldOfView * 0.5f / 180.0f * M_PI);
+    uint8_t Find(olc::Pixel color) const {
+        return inverse[((color.r >> 3) << 10) | ((color.g >> 3) << 5) | (color.b >> 3)];
+    }
+};
 
-        projectionMatrix.matrix[0][0] = aspectRatio * fovRadians;
-        projectionMatrix.matrix[1][1] = fovRadians;
-        projectionMatrix.matrix[2][2] = zFar / (zFar - zNear);
-        projectionMatrix.matrix[3][2] = (-zFar * zNear) / (zFar - zNear);
-        projectionMatrix.matrix[2][3] = 1.0f;
-        projectionMatrix.matrix[3][3] = 0.0f;
+enum class LightType { DIRECTIONAL, POINT, SPOT };
 
-        return true;
+struct Light { //struct defining a light source, directional lights reach everywhere while point and spot lights stop at their range
+    LightType type = LightType::POINT;
+    Vector3d position = { 0, 0, 0 };
+    Vector3d direction = { 0, 0, 1 }; //the way the light travels, for directional and spot lights
+    olc::Pixel color = olc::WHITE;
+    float intensity = 1.0f;
+    float range = 5.0f;
+    float spotInnerCos = 0.94f; //full brightness inside this cone
+    float spotOuterCos = 0.87f; //no light outside this cone
+    bool castsShadows = false; //only the first directional light with this set gets a shadow map
+};
+
+//largest amount the matrix stretches any axis by, so bounding spheres stay conservative after transforming
+float GetMaximumScale(const Matrix4x4& matrix) {
+    float maximumScale = 0.0f;
+    for (int row = 0; row < 3; row++) {
+        maximumScale = std::max(maximumScale, matrix.matrix[row][0] * matrix.matrix[row][0] +
+            matrix.matrix[row][1] * matrix.matrix[row][1] + matrix.matrix[row][2] * matrix.matrix[row][2]);
     }
+    return sqrtf(maximumScale);
+}
 
-    bool OnUserUpdate(float elapsedTime) override {
-        FillRect(0, 0, ScreenWidth(), ScreenHeight(), olc::BLACK);
+//smallest amount the matrix stretches any axis by, equal to GetMaximumScale when the scale is uniform
+float GetMinimumScale(const Matrix4x4& matrix) {
+    float minimumScale = INFINITY;
+    for (int row = 0; row < 3; row++) {
+        minimumScale = std::min(minimumScale, matrix.matrix[row][0] * matrix.matrix[row][0] +
+            matrix.matrix[row][1] * matrix.matrix[row][1] + matrix.matrix[row][2] * matrix.matrix[row][2]);
+    }
+    return sqrtf(minimumScale);
+}
 
-        theta += 1.0f * elapsedTime;
-        std::vector<Triangle> trianglesToDraw;
+//transpose of the inverse of the matrix's rotation and scale, normals stay perpendicular to surfaces under non-uniform scale
+Matrix4x4 MakeNormalMatrix(const Matrix4x4& m) {
+    Matrix4x4 inverse = InvertAffineMatrix(m);
+    Matrix4x4 normalMatrix;
+    for (int row = 0; row < 3; row++)
+        for (int column = 0; column < 3; column++)
+            normalMatrix.matrix[row][column] = inverse.matrix[column][row];
+    normalMatrix.matrix[3][3] = 1.0f;
+    return normalMatrix;
+}
 
-        for (auto triangle : meshCube.triangles) {
-            Triangle triangleProjected, triangleTranslated, triangleRotatedZ, triangleRotatedX, triangleRotatedY;
+struct MeshInstance { //struct defining one placed copy of a mesh, the mesh data itself is shared between all copies
+    Matrix4x4 transform = MakeIdentityMatrix();
+    olc::Pixel color = olc::WHITE;
+};
 
-            RotateObjectX(triangle, triangleRotatedX, 0);
-            RotateObjectY(triangleRotatedX, triangleRotatedY, theta);
-            RotateObjectZ(triangleRotatedY, triangleRotatedZ, 0);
+struct SceneNode { //struct defining one object in the scene, placed relative to its parent node
+    int parent = -1;
+    Matrix4x4 localTransform = MakeIdentityMatrix();
+    Matrix4x4 worldTransform = MakeIdentityMatrix();
+    const Mesh* mesh = nullptr;
+    olc::Pixel color = olc::WHITE;
 
-            triangleTranslated = triangleRotatedZ;
-            
-            for (int i = 0; i < 3; i++) {
-                triangleTranslated.points[i].z += 2.0f;
-                triangleTranslated.points[i].y += 1.0f;
-            }
+    //world space bounds of the node's mesh, only meaningful when it has one
+    Vector3d boundsMin = { 0, 0, 0 }, boundsMax = { 0, 0, 0 };
+    Vector3d boundsCenter = { 0, 0, 0 };
+    float boundsRadius = 0.0f;
+
+    bool dirty = true; //local transform changed since the last update
+    bool worldChanged = false; //world transform was recomputed by the last update
+};
 
-            Vector3d normal, line1, line2;
-            line1.x = triangleTranslated.points[1].x - triangleTranslated.points[0].x;
-            line1.y = triangleTranslated.points[1].y - triangleTranslated.points[0].y;
-            line1.z = triangleTranslated.points[1].z - triangleTranslated.points[0].z;
+class SceneGraph { //nodes are stored in one array with every parent ahead of its children, so one forward pass updates them all
 
-            line2.x = triangleTranslated.points[2].x - triangleTranslated.points[0].x;
-            line2.y = triangleTranslated.points[2].y - triangleTranslated.points[0].y;
-            line2.z = triangleTranslated.points[2].z - triangleTranslated.points[0].z;
+public:
+    std::vector<SceneNode> nodes;
 
-            normal.x = line1.y * line2.z - line1.z * line2.y;
-            normal.y = line1.z * line2.x - line1.x * line2.z;
-            normal.z = line1.x * line2.y - line1.y * line2.x;
+    int AddNode(int parent, const Matrix4x4& localTransform, const Mesh* mesh = nullptr, olc::Pixel color = olc::WHITE) {
+        if (parent >= (int)nodes.size())
+            throw std::out_of_range("Scene node parent must be added before its children");
 
-            NormalizeVector(normal);
+        SceneNode node;
+        node.parent = parent;
+        node.localTransform = localTransform;
+        node.mesh = mesh;
+        node.color = color;
+        nodes.push_back(node);
+        return (int)nodes.size() - 1;
+    }
 
-            if (normal.x * (triangleTranslated.points[0].x - camera.x) +
-                normal.y * (triangleTranslated.points[0].y - camera.y) +
-                normal.z * (triangleTranslated.points[0].z - camera.z) < 0)
-            {
-                Vector3d directionalLight = { 0, 0, -1 };
-                NormalizeVector(directionalLight);
+    void SetLocalTransform(int node, const Matrix4x4& localTransform) {
+        nodes[node].localTransform = localTransform;
+        nodes[node].dirty = true;
+    }
 
-                float dotProduct = normal.x * directionalLight.x + normal.y * directionalLight.y + normal.z * directionalLight.z;
+    //swaps the node's mesh, a node that gains or loses a mesh changes what the hierarchy holds so it needs rebuilding rather than a refit
+    void SetMesh(int node, const Mesh* mesh) {
+        nodes[node].mesh = mesh;
+        nodes[node].dirty = true;
+    }
 
-                triangleTranslated.color = GetShadeFromLumosity(dotProduct);
+    //recomputes world transforms and bounds for dirty nodes and everything below them, returns how many were touched
+    int UpdateWorldTransforms() {
+        int updated = 0;
+        for (auto& node : nodes) {
+            bool parentChanged = node.parent >= 0 && nodes[node.parent].worldChanged;
+            node.worldChanged = node.dirty || parentChanged;
+            node.dirty = false;
+            if (!node.worldChanged)
+                continue;
 
-                for (int i = 0; i < 3; i++) {
-                    MultiplyVectorByMatrix(triangleTranslated.points[i], triangleProjected.points[i], projectionMatrix);
-                }
-                triangleProjected.color = triangleTranslated.color;
-                ScaleTriangleToScreen(triangleProjected);
+            node.worldTransform = node.parent >= 0 ? MultiplyMatrices(node.localTransform, nodes[node.parent].worldTransform) : node.localTransform;
+            if (node.mesh)
+                UpdateBounds(node);
+            updated++;
+        }
+        return updated;
+    }
+
+private:
+    //world aabb from the mesh aabb, from Arvo's "Transforming Axis-Aligned Bounding Boxes" in Graphics Gems
+    void UpdateBounds(SceneNode& node) {
+        const Matrix4x4& m = node.worldTransform;
+        float localMin[3] = { node.mesh->boundsMin.x, node.mesh->boundsMin.y, node.mesh->boundsMin.z };
+        float localMax[3] = { node.mesh->boundsMax.x, node.mesh->boundsMax.y, node.mesh->boundsMax.z };
+        float worldMin[3] = { m.matrix[3][0], m.matrix[3][1], m.matrix[3][2] };
+        float worldMax[3] = { m.matrix[3][0], m.matrix[3][1], m.matrix[3][2] };
 
-                trianglesToDraw.push_back(triangleProjected);
+        for (int column = 0; column < 3; column++) {
+            for (int row = 0; row < 3; row++) {
+                float a = m.matrix[row][column] * localMin[row];
+                float b = m.matrix[row][column] * localMax[row];
+                worldMin[column] += std::min(a, b);
+                worldMax[column] += std::max(a, b);
             }
         }
 
-        sort(trianglesToDraw.begin(), trianglesToDraw.end(), [](Triangle& t1, Triangle& t2)
-            {
-                float t1Midpoint = t1.points[0].z + t1.points[1].z + t1.points[2].z / 3;
-                float t2Midpoint = t2.points[0].z + t2.points[1].z + t2.points[2].z / 3;
-                return t1Midpoint > t2Midpoint;
-            });
+        node.boundsMin = { worldMin[0], worldMin[1], worldMin[2] };
+        node.boundsMax = { worldMax[0], worldMax[1], worldMax[2] };
 
-        for (auto& triangleProjected : trianglesToDraw) {
-            FillTriangle(triangleProjected.points[0].x, triangleProjected.points[0].y, triangleProjected.points[1].x,
-                triangleProjected.points[1].y, triangleProjected.points[2].x, triangleProjected.points[2].y, triangleProjected.color);
-        }
+        const Vector3d& c = node.mesh->boundsCenter;
+        node.boundsCenter = {
+            c.x * m.matrix[0][0] + c.y * m.matrix[1][0] + c.z * m.matrix[2][0] + m.matrix[3][0],
+            c.x * m.matrix[0][1] + c.y * m.matrix[1][1] + c.z * m.matrix[2][1] + m.matrix[3][1],
+            c.x * m.matrix[0][2] + c.y * m.matrix[1][2] + c.z * m.matrix[2][2] + m.matrix[3][2]
+        };
+        node.boundsRadius = node.mesh->boundsRadius * GetMaximumScale(m);
+    }
+};
 
-        return true;
+struct Ray { //struct defining a half line from origin along direction, points are origin + direction * t
+    Vector3d origin;
+    Vector3d direction;
+};
+
+//slab test from https://tavianator.com/2011/ray_box.html, returns the entry distance or INFINITY on a miss
+float IntersectRayBox(const Ray& ray, const Vector3d& inverseDirection, const Vector3d& boxMin, const Vector3d& boxMax, float maxDistance) {
+    float tx1 = (boxMin.x - ray.origin.x) * inverseDirection.x, tx2 = (boxMax.x - ray.origin.x) * inverseDirection.x;
+    float ty1 = (boxMin.y - ray.origin.y) * inverseDirection.y, ty2 = (boxMax.y - ray.origin.y) * inverseDirection.y;
+    float tz1 = (boxMin.z - ray.origin.z) * inverseDirection.z, tz2 = (boxMax.z - ray.origin.z) * inverseDirection.z;
+    float tNear = std::max(std::max(std::min(tx1, tx2), std::min(ty1, ty2)), std::min(tz1, tz2));
+    float tFar = std::min(std::min(std::max(tx1, tx2), std::max(ty1, ty2)), std::max(tz1, tz2));
+    if (tFar < std::max(tNear, 0.0f) || tNear > maxDistance)
+        return INFINITY;
+    return std::max(tNear, 0.0f);
+}
+
+//Moller-Trumbore from https://en.wikipedia.org/wiki/M%C3%B6ller%E2%80%93Trumbore_intersection_algorithm, returns INFINITY on a miss
+float IntersectRayTriangle(const Ray& ray, const Vector3d& a, const Vector3d& b, const Vector3d& c) {
+    Vector3d edge1 = { b.x - a.x, b.y - a.y, b.z - a.z };
+    Vector3d edge2 = { c.x - a.x, c.y - a.y, c.z - a.z };
+    Vector3d h = { ray.direction.y * edge2.z - ray.direction.z * edge2.y, ray.direction.z * edge2.x - ray.direction.x * edge2.z, ray.direction.x * edge2.y - ray.direction.y * edge2.x };
+    float determinant = edge1.x * h.x + edge1.y * h.y + edge1.z * h.z;
+    if (fabsf(determinant) < 1e-8f)
+        return INFINITY;
+
+    float inverseDeterminant = 1.0f / determinant;
+    Vector3d s = { ray.origin.x - a.x, ray.origin.y - a.y, ray.origin.z - a.z };
+    float u = (s.x * h.x + s.y * h.y + s.z * h.z) * inverseDeterminant;
+    if (u < 0.0f || u > 1.0f)
+        return INFINITY;
+
+    Vector3d q = { s.y * edge1.z - s.z * edge1.y, s.z * edge1.x - s.x * edge1.z, s.x * edge1.y - s.y * edge1.x };
+    float v = (ray.direction.x * q.x + ray.direction.y * q.y + ray.direction.z * q.z) * inverseDeterminant;
+    if (v < 0.0f || u + v > 1.0f)
+        return INFINITY;
+
+    float t = (edge2.x * q.x + edge2.y * q.y + edge2.z * q.z) * inverseDeterminant;
+    return t > 0.0f ? t : INFINITY;
+}
+
+//bounding volume hierarchy over the mesh nodes of a scene, built with the binned surface area heuristic from
+//Wald's "On fast Construction of SAH-based Bounding Volume Hierarchies" and refitted in place when nodes move
+class BoundingVolumeHierarchy {
+
+private:
+    struct BvhNode {
+        Vector3d boundsMin, boundsMax;
+        int first = 0; //first item for leaves, right child for inner nodes (the left child always directly follows)
+        int count = 0; //items in a leaf, 0 for inner nodes
+    };
+
+    std::vector<BvhNode> nodes;
+    std::vector<int> items; //scene node indices, grouped by leaf
+    std::vector<Vector3d> centroids;
+
+    static constexpr int binCount = 12;
+    static constexpr int maxLeafItems = 4;
+
+    static float SurfaceArea(const Vector3d& boxMin, const Vector3d& boxMax) {
+        float dx = boxMax.x - boxMin.x, dy = boxMax.y - boxMin.y, dz = boxMax.z - boxMin.z;
+        return 2.0f * (dx * dy + dy * dz + dz * dx);
+    }
+
+    static void GrowBounds(Vector3d& boxMin, Vector3d& boxMax, const Vector3d& otherMin, const Vector3d& otherMax) {
+        boxMin = { std::min(boxMin.x, otherMin.x), std::min(boxMin.y, otherMin.y), std::min(boxMin.z, otherMin.z) };
+        boxMax = { std::max(boxMax.x, otherMax.x), std::max(boxMax.y, otherMax.y), std::max(boxMax.z, otherMax.z) };
+    }
+
+    static float Axis(const Vector3d& v, int axis) {
+        return axis == 0 ? v.x : (axis == 1 ? v.y : v.z);
+    }
+
+    void ComputeLeafBounds(BvhNode& node, const SceneGraph& scene) {
+        node.boundsMin = { INFINITY, INFINITY, INFINITY };
+        node.boundsMax = { -INFINITY, -INFINITY, -INFINITY };
+        for (int i = node.first; i < node.first + node.count; i++)
+            GrowBounds(node.boundsMin, node.boundsMax, scene.nodes[items[i]].boundsMin, scene.nodes[items[i]].boundsMax);
     }
+
+    void Subdivide(int nodeIndex, const SceneGraph& scene, int first, int count) {
+        nodes[nodeIndex].first = first;
+        nodes[nodeIndex].count = count;
+        ComputeLeafBounds(nodes[nodeIndex], scene);
+        if (count <= maxLeafItems)
+            return;
+
+        Vector3d centroidMin = { INFINITY, INFINITY, INFINITY }, centroidMax = { -INFINITY, -INFINITY, -INFINITY };
+        for (int i = first; i < first + count; i++)
+            GrowBounds(centroidMin, centroidMax, centroids[items[i]], centroids[items[i]]);
+
+        int bestAxis = -1, bestSplit = 0;
+        float bestCost = SurfaceArea(nodes[nodeIndex].boundsMin, nodes[nodeIndex].boundsMax) * count;
+        for (int axis = 0; axis < 3; axis++) {
+            float lo = Axis(centroidMin, axis), hi = Axis(centroidMax, axis);
+            if (hi <= lo)
+                continue;
+
+            struct Bin { Vector3d boundsMin = { INFINITY, INFINITY, INFINITY }, boundsMax = { -INFINITY, -INFINITY, -INFINITY }; int count = 0; } bins[binCount];
+            float binScale = binCount / (hi - lo);
+            for (int i = first; i < first + count; i++) {
+                const SceneNode& item = scene.nodes[items[i]];
+                int bin = std::min(binCount - 1, (int)((Axis(centroids[items[i]], axis) - lo) * binScale));
+                GrowBounds(bins[bin].boundsMin, bins[bin].boundsMax, item.boundsMin, item.boundsMax);
+                bins[bin].count++;
+            }
+
+            //sweep from both ends so every split plane's cost is known in two passes
+            float leftArea[binCount - 1], rightArea[binCount - 1];
+            int leftCount[binCount - 1], rightCount[binCount - 1];
+            Bin left, right;
+            for (int i = 0; i < binCount - 1; i++) {
+                GrowBounds(left.boundsMin, left.boundsMax, bins[i].boundsMin, bins[i].boundsMax);
+                left.count += bins[i].count;
+                leftCount[i] = left.count;
+                leftArea[i] = left.count ? SurfaceArea(left.boundsMin, left.boundsMax) : 0.0f;
+
+                GrowBounds(right.boundsMin, right.boundsMax, bins[binCount - 1 - i].boundsMin, bins[binCount - 1 - i].boundsMax);
+                right.count += bins[binCount - 1 - i].count;
+                rightCount[binCount - 2 - i] = right.count;
+                rightArea[binCount - 2 - i] = right.count ? SurfaceArea(right.boundsMin, right.boundsMax) : 0.0f;
+            }
+
+            for (int i = 0; i < binCount - 1; i++) {
+                float cost = leftArea[i] * leftCount[i] + rightArea[i] * rightCount[i];
+                if (leftCount[i] > 0 && rightCount[i] > 0 && cost < bestCost) {
+                    bestCost = cost;
+                    bestAxis = axis;
+                    bestSplit = i;
+                }
+            }
+        }
+
+        if (bestAxis < 0)
+            return;
+
+        float lo = Axis(centroidMin, bestAxis), binScale = binCount / (Axis(centroidMax, bestAxis) - lo);
+        int* middle = std::partition(items.data() + first, items.data() + first + count, [&](int item) {
+            return std::min(binCount - 1, (int)((Axis(centroids[item], bestAxis) - lo) * binScale)) <= bestSplit;
+        });
+        int leftCount = (int)(middle - (items.data() + first));
+
+        int leftChild = (int)nodes.size();
+        nodes.emplace_back();
+        Subdivide(leftChild, scene, first, leftCount);
+        int rightChild = (int)nodes.size();
+        nodes.emplace_back();
+        Subdivide(rightChild, scene, first + leftCount, count - leftCount);
+
+        nodes[nodeIndex].first = rightChild;
+        nodes[nodeIndex].count = 0;
+    }
+
+public:
+    void Build(const SceneGraph& scene) {
+        nodes.clear();
+        items.clear();
+        centroids.resize(scene.nodes.size());
+        for (int i = 0; i < (int)scene.nodes.size(); i++) {
+            const SceneNode& node = scene.nodes[i];
+            if (!node.mesh)
+                continue;
+            items.push_back(i);
+            centroids[i] = { (node.boundsMin.x + node.boundsMax.x) * 0.5f, (node.boundsMin.y + node.boundsMax.y) * 0.5f, (node.boundsMin.z + node.boundsMax.z) * 0.5f };
+        }
+
+        nodes.reserve(items.size() * 2);
+        nodes.emplace_back();
+        Subdivide(0, scene, 0, (int)items.size());
+    }
+
+    //keeps the tree shape and only recomputes bounds, children are always stored after their parent so one reverse pass is enough
+    void Refit(const SceneGraph& scene) {
+        if (nodes.empty() || items.empty())
+            return;
+        for (int i = (int)nodes.size() - 1; i >= 0; i--) {
+            BvhNode& node = nodes[i];
+            if (node.count > 0) {
+                ComputeLeafBounds(node, scene);
+                continue;
+            }
+            const BvhNode& left = nodes[i + 1];
+            const BvhNode& right = nodes[node.first];
+            node.boundsMin = left.boundsMin;
+            node.boundsMax = left.boundsMax;
+            GrowBounds(node.boundsMin, node.boundsMax, right.boundsMin, right.boundsMax);
+        }
+    }
+
+    //collects the scene nodes whose bounds touch the frustum, subtrees fully inside are taken without further tests
+    void CullFrustum(const Frustum& frustum, std::vector<int>& visibleNodes) const {
+        if (nodes.empty() || items.empty())
+            return;
+
+        //the tree's depth isn't bounded, so the stack grows rather than dropping subtrees
+        std::vector<std::pair<int, bool>> stack;
+        stack.reserve(64);
+        stack.push_back({ 0, false });
+
+        while (!stack.empty()) {
+            int nodeIndex = stack.back().first;
+            bool inside = stack.back().second;
+            stack.pop_back();
+            const BvhNode& node = nodes[nodeIndex];
+
+            if (!inside) {
+                Frustum::Containment containment = frustum.TestBox(node.boundsMin, node.boundsMax);
+                if (containment == Frustum::Containment::OUTSIDE)
+                    continue;
+                inside = containment == Frustum::Containment::INSIDE;
+            }
+
+            if (node.count > 0) {
+                visibleNodes.insert(visibleNodes.end(), items.begin() + node.first, items.begin() + node.first + node.count);
+            }
+            else {
+                stack.push_back({ node.first, inside });
+                stack.push_back({ nodeIndex + 1, inside });
+            }
+        }
+    }
+
+    //nearest scene node hit by the ray, tested down to its triangles through the mesh's clusters, or -1 if nothing is hit
+    int Raycast(const SceneGraph& scene, const Ray& ray, float& hitDistance) const {
+        hitDistance = INFINITY;
+        if (nodes.empty() || items.empty())
+            return -1;
+
+        Vector3d inverseDirection = { 1.0f / ray.direction.x, 1.0f / ray.direction.y, 1.0f / ray.direction.z };
+        int hitNode = -1;
+        std::vector<int> stack;
+        stack.reserve(64);
+        stack.push_back(0);
+
+        while (!stack.empty()) {
+            const BvhNode& node = nodes[stack.back()];
+            stack.pop_back();
+            if (IntersectRayBox(ray, inverseDirection, node.boundsMin, node.boundsMax, hitDistance) == INFINITY)
+                continue;
+
+            if (node.count == 0) {
+                stack.push_back(node.first);
+                stack.push_back((int)(&node - nodes.data()) + 1);
+                continue;
+            }
+
+            for (int i = node.first; i < node.first + node.count; i++) {
+                const SceneNode& sceneNode = scene.nodes[items[i]];
+                const MeshLevelOfDetail& fullDetail = sceneNode.mesh->levelsOfDetail[0];
+
+                //an affine transform keeps the ray parameter, so distances found in object space compare directly
+                Matrix4x4 worldToObject = InvertAffineMatrix(sceneNode.worldTransform);
+                Ray objectRay;
+                const Matrix4x4& m = worldToObject;
+                objectRay.origin = {
+                    ray.origin.x * m.matrix[0][0] + ray.origin.y * m.matrix[1][0] + ray.origin.z * m.matrix[2][0] + m.matrix[3][0],
+                    ray.origin.x * m.matrix[0][1] + ray.origin.y * m.matrix[1][1] + ray.origin.z * m.matrix[2][1] + m.matrix[3][1],
+                    ray.origin.x * m.matrix[0][2] + ray.origin.y * m.matrix[1][2] + ray.origin.z * m.matrix[2][2] + m.matrix[3][2]
+                };
+                objectRay.direction = {
+                    ray.direction.x * m.matrix[0][0] + ray.direction.y * m.matrix[1][0] + ray.direction.z * m.matrix[2][0],
+                    ray.direction.x * m.matrix[0][1] + ray.direction.y * m.matrix[1][1] + ray.direction.z * m.matrix[2][1],
+                    ray.direction.x * m.matrix[0][2] + ray.direction.y * m.matrix[1][2] + ray.direction.z * m.matrix[2][2]
+                };
+                float directionLength2 = objectRay.direction.x * objectRay.direction.x + objectRay.direction.y * objectRay.direction.y + objectRay.direction.z * objectRay.direction.z;
+
+                for (auto& cluster : fullDetail.clusters) {
+                    //ray against the cluster's bounding sphere before touching its triangles
+                    Vector3d toCenter = { cluster.center.x - objectRay.origin.x, cluster.center.y - objectRay.origin.y, cluster.center.z - objectRay.origin.z };
+                    float along = (toCenter.x * objectRay.direction.x + toCenter.y * objectRay.direction.y + toCenter.z * objectRay.direction.z) / directionLength2;
+                    Vector3d closest = { toCenter.x - objectRay.direction.x * along, toCenter.y - objectRay.direction.y * along, toCenter.z - objectRay.direction.z * along };
+                    if (closest.x * closest.x + closest.y * closest.y + closest.z * closest.z > cluster.radius * cluster.radius)
+                        continue;
+
+                    for (int index = cluster.firstIndex; index < cluster.firstIndex + cluster.indexCount; index += 3) {
+                        float t = IntersectRayTriangle(objectRay, sceneNode.mesh->vertices[fullDetail.indices[index]],
+                            sceneNode.mesh->vertices[fullDetail.indices[index + 1]], sceneNode.mesh->vertices[fullDetail.indices[index + 2]]);
+                        if (t < hitDistance) {
+                            hitDistance = t;
+                            hitNode = items[i];
+                        }
+                    }
+                }
+            }
+        }
+        return hitNode;
+    }
+};
+
+//walks the pixel centres covered by a screen space triangle, calling shade(x, y, w0, w1, w2) with its barycentric weights
+//uses the top-left fill rule, so pixels on an edge shared by two triangles are only visited once
+template<typename PixelFunction>
+void RasterizeTriangle(const Vector3d (&points)[3], int width, int height, PixelFunction shade) {
+    float x0 = points[0].x, y0 = points[0].y;
+    float x1 = points[1].x, y1 = points[1].y;
+    float x2 = points[2].x, y2 = points[2].y;
+
+    float area = (x1 - x0) * (y2 - y0) - (y1 - y0) * (x2 - x0);
+    if (area == 0.0f)
+        return;
+    if (area < 0.0f) {
+        std::swap(x1, x2);
+        std::swap(y1, y2);
+    }
+
+    int minX = std::max(0, (int)floorf(std::min(x0, std::min(x1, x2))));
+    int maxX = std::min(width - 1, (int)ceilf(std::max(x0, std::max(x1, x2))));
+    int minY = std::max(0, (int)floorf(std::min(y0, std::min(y1, y2))));
+    int maxY = std::min(height - 1, (int)ceilf(std::max(y0, std::max(y1, y2))));
+    if (minX > maxX || minY > maxY)
+        return;
+
+    //edge i is opposite vertex i, so its value divided by the area is that vertex's barycentric weight
+    float stepX[3] = { y1 - y2, y2 - y0, y0 - y1 };
+    float stepY[3] = { x2 - x1, x0 - x2, x1 - x0 };
+    float constant[3] = { x1 * y2 - y1 * x2, x2 * y0 - y2 * x0, x0 * y1 - y0 * x1 };
+    bool topLeft[3];
+    for (int e = 0; e < 3; e++)
+        topLeft[e] = stepX[e] > 0.0f || (stepX[e] == 0.0f && stepY[e] < 0.0f);
+
+    float inverseArea = 1.0f / fabsf(area);
+    bool swapped = area < 0.0f;
+
+    for (int y = minY; y <= maxY; y++) {
+        float py = (float)y + 0.5f;
+        float edge[3];
+        for (int e = 0; e < 3; e++)
+            edge[e] = stepX[e] * ((float)minX + 0.5f) + stepY[e] * py + constant[e];
+
+        for (int x = minX; x <= maxX; x++) {
+            bool inside = true;
+            for (int e = 0; e < 3; e++)
+                inside &= edge[e] > 0.0f || (edge[e] == 0.0f && topLeft[e]);
+
+            if (inside) {
+                float w0 = edge[0] * inverseArea, w1 = edge[1] * inverseArea, w2 = edge[2] * inverseArea;
+                if (swapped)
+                    shade(x, y, w0, w2, w1);
+                else
+                    shade(x, y, w0, w1, w2);
+            }
+
+            for (int e = 0; e < 3; e++)
+                edge[e] += stepX[e];
+        }
+    }
+}
+
+struct ShadowMap { //struct defining the depth of the nearest caster seen along a directional light, used to test whether points are lit
+    int size = 0;
+    std::vector<float> depth;
+    Vector3d axes[3]; //right, up and the light direction
+    float offsets[3] = { 0, 0, 0 };
+    float texelsPerUnit = 1.0f;
+    float bias = 1.5f; //in texels so it follows the resolution
+    float normalOffset = 1.5f; //also in texels, pushing the test point off the surface keeps acne away at grazing angles
+    int filterRadius = 1; //percentage closer filtering over (2r+1)^2 texels, 0 for a single hard test
+    bool backFacesOnly = true; //casters facing the light are skipped, so the depth stored is the far side of closed meshes and lit surfaces can't shadow themselves, whatever level of detail they're drawn at
+
+    void Setup(int newSize) {
+        size = newSize;
+        depth.assign((size_t)size * size, INFINITY);
+    }
+
+    //orthographic projection along the light that just covers the given world bounds
+    void Fit(const Vector3d& direction, const Vector3d& boundsMin, const Vector3d& boundsMax) {
+        Vector3d up = fabsf(direction.y) < 0.99f ? Vector3d{ 0, 1, 0 } : Vector3d{ 1, 0, 0 };
+        Vector3d right = { up.y * direction.z - up.z * direction.y, up.z * direction.x - up.x * direction.z, up.x * direction.y - up.y * direction.x };
+        float length = sqrtf(right.x * right.x + right.y * right.y + right.z * right.z);
+        right = { right.x / length, right.y / length, right.z / length };
+        axes[0] = right;
+        axes[1] = { direction.y * right.z - direction.z * right.y, direction.z * right.x - direction.x * right.z, direction.x * right.y - direction.y * right.x };
+        axes[2] = direction;
+
+        float minimum[3] = { INFINITY, INFINITY, INFINITY }, maximum[3] = { -INFINITY, -INFINITY, -INFINITY };
+        for (int corner = 0; corner < 8; corner++) {
+            Vector3d v = { corner & 1 ? boundsMax.x : boundsMin.x, corner & 2 ? boundsMax.y : boundsMin.y, corner & 4 ? boundsMax.z : boundsMin.z };
+            for (int axis = 0; axis < 3; axis++) {
+                float d = v.x * axes[axis].x + v.y * axes[axis].y + v.z * axes[axis].z;
+                minimum[axis] = std::min(minimum[axis], d);
+                maximum[axis] = std::max(maximum[axis], d);
+            }
+        }
+
+        //square texels, sized by the wider of the two axes
+        texelsPerUnit = size / std::max(std::max(maximum[0] - minimum[0], maximum[1] - minimum[1]), 1e-6f);
+        for (int axis = 0; axis < 3; axis++)
+            offsets[axis] = -minimum[axis];
+    }
+
+    //x and y in texels, z in world units along the light
+    Vector3d ToShadowSpace(const Vector3d& v) const {
+        return {
+            (v.x * axes[0].x + v.y * axes[0].y + v.z * axes[0].z + offsets[0]) * texelsPerUnit,
+            (v.x * axes[1].x + v.y * axes[1].y + v.z * axes[1].z + offsets[1]) * texelsPerUnit,
+            v.x * axes[2].x + v.y * axes[2].y + v.z * axes[2].z + offsets[2]
+        };
+    }
+
+    void Clear() {
+        std::fill(depth.begin(), depth.end(), INFINITY);
+    }
+
+    //depth only, no shading or colour so casters cost little more than the edge tests
+    void RasterizeCaster(const Vector3d (&points)[3]) {
+        float z0 = points[0].z, z1 = points[1].z, z2 = points[2].z;
+        RasterizeTriangle(points, size, size, [&](int x, int y, float w0, float w1, float w2) {
+            float& stored = depth[(size_t)y * size + x];
+            stored = std::min(stored, w0 * z0 + w1 * z1 + w2 * z2);
+        });
+    }
+
+    //fraction of the filter taps that see the point, anything outside the map counts as lit
+    float GetVisibility(const Vector3d& position, const Vector3d& normal) const {
+        float offset = normalOffset / texelsPerUnit;
+        Vector3d texel = ToShadowSpace({ position.x + normal.x * offset, position.y + normal.y * offset, position.z + normal.z * offset });
+        int centerX = (int)floorf(texel.x), centerY = (int)floorf(texel.y);
+        if (centerX < 0 || centerY < 0 || centerX >= size || centerY >= size)
+            return 1.0f;
+
+        float testDepth = texel.z - bias / texelsPerUnit;
+        int lit = 0, taps = 0;
+        for (int y = centerY - filterRadius; y <= centerY + filterRadius; y++) {
+            for (int x = centerX - filterRadius; x <= centerX + filterRadius; x++) {
+                int clampedX = std::max(0, std::min(size - 1, x)), clampedY = std::max(0, std::min(size - 1, y));
+                lit += testDepth <= depth[(size_t)clampedY * size + clampedX];
+                taps++;
+            }
+        }
+        return (float)lit / taps;
+    }
+};
+
+//low resolution software depth buffer for occlusion culling, in the spirit of Intel's masked occlusion culling
+//(https://www.intel.com/content/www/us/en/developer/articles/technical/masked-software-occlusion-culling.html)
+//occluders write their farthest view depth per pixel, then a max depth pyramid answers conservative box queries
+class OcclusionBuffer {
+
+private:
+    int width = 0, height = 0, paddedWidth = 0;
+    float projectionScaleX = 1.0f, projectionScaleY = 1.0f, nearPlane = 0.1f;
+    std::vector<std::vector<float>> levels; //level 0 is full resolution, each next level holds the max of a 2x2 block
+    std::vector<int> levelWidths, levelHeights;
+
+    bool ProjectPoint(const Vector3d& v, float& x, float& y) const {
+        if (v.z < nearPlane)
+            return false;
+        x = (v.x * projectionScaleX / v.z + 1.0f) * 0.5f * (float)width;
+        y = (v.y * projectionScaleY / v.z + 1.0f) * 0.5f * (float)height;
+        return true;
+    }
+
+public:
+    void Setup(int bufferWidth, int bufferHeight, const Matrix4x4& projectionMatrix, float zNear) {
+        width = bufferWidth;
+        height = bufferHeight;
+        paddedWidth = (width + 3) & ~3;
+        projectionScaleX = projectionMatrix.matrix[0][0];
+        projectionScaleY = projectionMatrix.matrix[1][1];
+        nearPlane = zNear;
+
+        levels.clear();
+        levelWidths.clear();
+        levelHeights.clear();
+        int levelWidth = paddedWidth, levelHeight = height;
+        while (true) {
+            levels.emplace_back((size_t)levelWidth * levelHeight, INFINITY);
+            levelWidths.push_back(levelWidth);
+            levelHeights.push_back(levelHeight);
+            if (levelWidth <= 1 && levelHeight <= 1)
+                break;
+            levelWidth = std::max(1, (levelWidth + 1) / 2);
+            levelHeight = std::max(1, (levelHeight + 1) / 2);
+        }
+    }
+
+    void Clear() {
+        std::fill(levels[0].begin(), levels[0].end(), INFINITY);
+    }
+
+    //rasterizes a view space triangle, covering pixel centres with the triangle's farthest depth so the buffer never claims more than it hides
+    void RasterizeOccluder(const Vector3d& a, const Vector3d& b, const Vector3d& c) {
+        float x0, y0, x1, y1, x2, y2;
+        if (!ProjectPoint(a, x0, y0) || !ProjectPoint(b, x1, y1) || !ProjectPoint(c, x2, y2))
+            return;
+
+        float area = (x1 - x0) * (y2 - y0) - (y1 - y0) * (x2 - x0);
+        if (area == 0.0f)
+            return;
+        if (area < 0.0f) {
+            std::swap(x1, x2);
+            std::swap(y1, y2);
+        }
+
+        int minX = std::max(0, (int)floorf(std::min(x0, std::min(x1, x2))));
+        int maxX = std::min(width - 1, (int)ceilf(std::max(x0, std::max(x1, x2))));
+        int minY = std::max(0, (int)floorf(std::min(y0, std::min(y1, y2))));
+        int maxY = std::min(height - 1, (int)ceilf(std::max(y0, std::max(y1, y2))));
+        if (minX > maxX || minY > maxY)
+            return;
+
+        float depth = std::max(a.z, std::max(b.z, c.z));
+
+        //edge functions E(x, y) = stepX * x + stepY * y + constant, all three are >= 0 inside the triangle
+        float stepX[3] = { y0 - y1, y1 - y2, y2 - y0 };
+        float stepY[3] = { x1 - x0, x2 - x1, x0 - x2 };
+        float constant[3] = { x0 * y1 - y0 * x1, x1 * y2 - y1 * x2, x2 * y0 - y2 * x0 };
+        float* depthBuffer = levels[0].data();
+
+        for (int y = minY; y <= maxY; y++) {
+            float py = (float)y + 0.5f;
+            float* row = depthBuffer + (size_t)y * paddedWidth;
+            int x = minX & ~3;
+
+#if defined(GRAPHICS_ENGINE_SSE2)
+            __m128 triangleDepth = _mm_set1_ps(depth);
+            __m128 edgeStep[3], edgeRow[3];
+            __m128 offsets = _mm_set_ps(3.5f, 2.5f, 1.5f, 0.5f);
+            for (int e = 0; e < 3; e++) {
+                edgeStep[e] = _mm_set1_ps(stepX[e] * 4.0f);
+                edgeRow[e] = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(stepX[e]), _mm_add_ps(_mm_set1_ps((float)x), offsets)), _mm_set1_ps(stepY[e] * py + constant[e]));
+            }
+            __m128i lane = _mm_set_epi32(x + 3, x + 2, x + 1, x);
+            __m128i laneStep = _mm_set1_epi32(4);
+            __m128i laneMin = _mm_set1_epi32(minX - 1), laneMax = _mm_set1_epi32(maxX + 1);
+            __m128 zero = _mm_setzero_ps();
+
+            for (; x <= maxX; x += 4) {
+                __m128 inside = _mm_and_ps(_mm_and_ps(_mm_cmpge_ps(edgeRow[0], zero), _mm_cmpge_ps(edgeRow[1], zero)), _mm_cmpge_ps(edgeRow[2], zero));
+                __m128i inSpan = _mm_and_si128(_mm_cmpgt_epi32(lane, laneMin), _mm_cmplt_epi32(lane, laneMax));
+                inside = _mm_and_ps(inside, _mm_castsi128_ps(inSpan));
+
+                __m128 current = _mm_loadu_ps(row + x);
+                __m128 closer = _mm_min_ps(current, triangleDepth);
+                _mm_storeu_ps(row + x, _mm_or_ps(_mm_and_ps(inside, closer), _mm_andnot_ps(inside, current)));
+
+                for (int e = 0; e < 3; e++)
+                    edgeRow[e] = _mm_add_ps(edgeRow[e], edgeStep[e]);
+                lane = _mm_add_epi32(lane, laneStep);
+            }
+#else
+            for (x = minX; x <= maxX; x++) {
+                float px = (float)x + 0.5f;
+                if (stepX[0] * px + stepY[0] * py + constant[0] >= 0.0f &&
+                    stepX[1] * px + stepY[1] * py + constant[1] >= 0.0f &&
+                    stepX[2] * px + stepY[2] * py + constant[2] >= 0.0f)
+                    row[x] = std::min(row[x], depth);
+            }
+#endif
+        }
+    }
+
+    //fills every coarser level with the farthest depth of the 2x2 block below it
+    void BuildPyramid() {
+        for (size_t level = 1; level < levels.size(); level++) {
+            const std::vector<float>& source = levels[level - 1];
+            std::vector<float>& target = levels[level];
+            int sourceWidth = levelWidths[level - 1], sourceHeight = levelHeights[level - 1];
+            int targetWidth = levelWidths[level], targetHeight = levelHeights[level];
+
+            for (int y = 0; y < targetHeight; y++) {
+                const float* row0 = source.data() + (size_t)std::min(y * 2, sourceHeight - 1) * sourceWidth;
+                const float* row1 = source.data() + (size_t)std::min(y * 2 + 1, sourceHeight - 1) * sourceWidth;
+                float* out = target.data() + (size_t)y * targetWidth;
+                int x = 0;
+
+#if defined(GRAPHICS_ENGINE_SSE2)
+                for (; x + 4 <= targetWidth && x * 2 + 8 <= sourceWidth; x += 4) {
+                    __m128 low = _mm_max_ps(_mm_loadu_ps(row0 + x * 2), _mm_loadu_ps(row1 + x * 2));
+                    __m128 high = _mm_max_ps(_mm_loadu_ps(row0 + x * 2 + 4), _mm_loadu_ps(row1 + x * 2 + 4));
+                    __m128 even = _mm_shuffle_ps(low, high, _MM_SHUFFLE(2, 0, 2, 0));
+                    __m128 odd = _mm_shuffle_ps(low, high, _MM_SHUFFLE(3, 1, 3, 1));
+                    _mm_storeu_ps(out + x, _mm_max_ps(even, odd));
+                }
+#endif
+                for (; x < targetWidth; x++) {
+                    int left = std::min(x * 2, sourceWidth - 1), right = std::min(x * 2 + 1, sourceWidth - 1);
+                    out[x] = std::max(std::max(row0[left], row0[right]), std::max(row1[left], row1[right]));
+                }
+            }
+        }
+    }
+
+    //true when a view space box lies entirely behind what the occluders already cover
+    bool IsBoxOccluded(const Vector3d& boxMin, const Vector3d& boxMax) const {
+        if (boxMin.z < nearPlane)
+            return false;
+
+        float minX = INFINITY, minY = INFINITY, maxX = -INFINITY, maxY = -INFINITY;
+        for (int corner = 0; corner < 8; corner++) {
+            Vector3d v = { corner & 1 ? boxMax.x : boxMin.x, corner & 2 ? boxMax.y : boxMin.y, corner & 4 ? boxMax.z : boxMin.z };
+            float x = 0.0f, y = 0.0f;
+            ProjectPoint(v, x, y);
+            minX = std::min(minX, x); maxX = std::max(maxX, x);
+            minY = std::min(minY, y); maxY = std::max(maxY, y);
+        }
+
+        int x0 = std::max(0, (int)floorf(minX)), x1 = std::min(width - 1, (int)floorf(maxX));
+        int y0 = std::max(0, (int)floorf(minY)), y1 = std::min(height - 1, (int)floorf(maxY));
+        if (x0 > x1 || y0 > y1)
+            return false;
+
+        //coarsest level where the box still spans only a couple of texels each way
+        size_t level = 0;
+        while (level + 1 < levels.size() && ((x1 - x0) >> level) > 1 && ((y1 - y0) >> level) > 1)
+            level++;
+
+        const std::vector<float>& depths = levels[level];
+        int levelWidth = levelWidths[level];
+        for (int y = y0 >> level; y <= (y1 >> level); y++) {
+            for (int x = x0 >> level; x <= (x1 >> level); x++) {
+                if (depths[(size_t)y * levelWidth + x] >= boxMin.z)
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    bool IsSphereOccluded(const Vector3d& center, float radius) const {
+        return IsBoxOccluded({ center.x - radius, center.y - radius, center.z - radius }, { center.x + radius, center.y + radius, center.z + radius });
+    }
+};
+
+//sorts triangles back to front for the painter's algorithm, by sorting 32 bit depth keys paired with triangle indices
+//instead of moving whole triangles around
+class DepthSorter {
+
+public:
+    enum class Mode { COMPARISON, RADIX };
+
+    Mode mode = Mode::RADIX;
+    int threadCount = 0; //threads for the radix passes on big batches, 0 uses every hardware thread
+    size_t parallelThreshold = 1 << 16;
+
+    DepthSorter() = default;
+
+    ~DepthSorter() {
+        {
+            std::lock_guard<std::mutex> lock(helperMutex);
+            helpersStopping = true;
+        }
+        helperStart.notify_all();
+        for (auto& helper : helpers)
+            helper.join();
+    }
+
+private:
+    static constexpr int bucketCount = 1 << 11;
+
+    std::vector<uint32_t> keys, keysScratch;
+    std::vector<uint32_t> values, valuesScratch;
+    std::vector<uint32_t> previousOrder;
+    std::vector<std::vector<uint32_t>> histograms;
+
+    std::vector<std::thread> helpers;
+    std::mutex helperMutex;
+    std::condition_variable helperStart, helperDone;
+    const std::function<void(int)>* helperWork = nullptr;
+    int helperThreads = 0, helpersBusy = 0;
+    uint64_t helperGeneration = 0;
+    bool helpersStopping = false;
+
+    //sum of the three projected depths, flipped so that farther triangles get smaller keys and come out first
+    static uint32_t MakeKey(const Triangle& triangle) {
+        float depth = triangle.points[0].z + triangle.points[1].z + triangle.points[2].z;
+        uint32_t bits;
+        memcpy(&bits, &depth, sizeof(bits));
+        bits ^= (bits & 0x80000000u) ? 0xFFFFFFFFu : 0x80000000u;
+        return ~bits;
+    }
+
+    //least significant digit first, each pass is a stable counting sort, and passes where every key shares a digit are skipped
+    void RadixSort(size_t count) {
+        constexpr int digitBits[3] = { 11, 11, 10 }; //local rather than a static member, which C++14 would need defined out of class
+        keysScratch.resize(count);
+        valuesScratch.resize(count);
+
+        int threads = (int)std::max(1u, threadCount > 0 ? (unsigned)threadCount : std::thread::hardware_concurrency());
+        if (count < parallelThreshold)
+            threads = 1;
+        histograms.resize(threads);
+        size_t chunk = (count + threads - 1) / threads;
+
+        //one read of the keys counts all three digits, each chunk separately so the first pass that moves anything can
+        //scatter from them directly
+        RunOnThreads(threads, [&](int t) {
+            std::vector<uint32_t>& histogram = histograms[t];
+            histogram.assign(3 * bucketCount, 0);
+            size_t end = std::min(count, (t + 1) * chunk);
+            for (size_t i = t * chunk; i < end; i++) {
+                uint32_t key = keys[i];
+                histogram[key & ((1u << digitBits[0]) - 1)]++;
+                histogram[bucketCount + ((key >> digitBits[0]) & ((1u << digitBits[1]) - 1))]++;
+                histogram[2 * bucketCount + (key >> (digitBits[0] + digitBits[1]))]++;
+            }
+        });
+
+        bool scattered = false;
+        int shift = 0;
+        for (int pass = 0; pass < 3; pass++) {
+            uint32_t mask = (1u << digitBits[pass]) - 1;
+            size_t base = pass * bucketCount;
+
+            //the totals of a digit don't depend on the order earlier passes left the keys in, so the first read decides the skip
+            bool singleDigit = false;
+            for (uint32_t digit = 0; digit <= mask && !singleDigit; digit++) {
+                uint32_t total = 0;
+                for (int t = 0; t < threads; t++)
+                    total += histograms[t][base + digit];
+                singleDigit = total == count;
+            }
+            if (singleDigit) {
+                shift += digitBits[pass];
+                continue;
+            }
+
+            //after a scatter each chunk holds different keys, so the per chunk counts are taken again, which one thread never needs
+            if (scattered && threads > 1) {
+                RunOnThreads(threads, [&](int t) {
+                    uint32_t* histogram = histograms[t].data() + base;
+                    std::fill(histogram, histogram + bucketCount, 0);
+                    size_t end = std::min(count, (t + 1) * chunk);
+                    for (size_t i = t * chunk; i < end; i++)
+                        histogram[(keys[i] >> shift) & mask]++;
+                });
+            }
+
+            //turn the per thread counts into per thread starting offsets, thread order keeps the sort stable
+            uint32_t offset = 0;
+            for (uint32_t digit = 0; digit <= mask; digit++) {
+                for (int t = 0; t < threads; t++) {
+                    uint32_t digitCount = histograms[t][base + digit];
+                    histograms[t][base + digit] = offset;
+                    offset += digitCount;
+                }
+            }
+
+            RunOnThreads(threads, [&](int t) {
+                uint32_t* offsets = histograms[t].data() + base;
+                size_t end = std::min(count, (t + 1) * chunk);
+                for (size_t i = t * chunk; i < end; i++) {
+                    uint32_t destination = offsets[(keys[i] >> shift) & mask]++;
+                    keysScratch[destination] = keys[i];
+                    valuesScratch[destination] = values[i];
+                }
+            });
+            keys.swap(keysScratch);
+            values.swap(valuesScratch);
+            scattered = true;
+            shift += digitBits[pass];
+        }
+    }
+
+    //runs work(0) here and work(1) to work(threads - 1) on helpers that are started the first time they're needed and
+    //then kept, so a frame's passes cost a wake up each rather than a thread start
+    void RunOnThreads(int threads, const std::function<void(int)>& work) {
+        if (threads == 1) {
+            work(0);
+            return;
+        }
+        while ((int)helpers.size() < threads - 1)
+            helpers.emplace_back(&DepthSorter::Help, this, (int)helpers.size() + 1);
+        {
+            std::lock_guard<std::mutex> lock(helperMutex);
+            helperWork = &work;
+            helperThreads = threads;
+            helpersBusy = threads - 1;
+            helperGeneration++;
+        }
+        helperStart.notify_all();
+        work(0);
+        std::unique_lock<std::mutex> lock(helperMutex);
+        helperDone.wait(lock, [this] { return helpersBusy == 0; });
+        helperWork = nullptr;
+    }
+
+    void Help(int t) {
+        uint64_t seen = 0;
+        while (true) {
+            const std::function<void(int)>* work;
+            {
+                std::unique_lock<std::mutex> lock(helperMutex);
+                helperStart.wait(lock, [&] { return helpersStopping || helperGeneration != seen; });
+                if (helpersStopping)
+                    return;
+                seen = helperGeneration;
+                if (t >= helperThreads) //a smaller batch of work than there are helpers
+                    continue;
+                work = helperWork;
+            }
+            (*work)(t);
+            {
+                std::lock_guard<std::mutex> lock(helperMutex);
+                helpersBusy--;
+            }
+            helperDone.notify_one();
+        }
+    }
+
+    //few descents can still hide a key that travels a long way, so once the shifts run past the budget this gives up
+    //and returns false, leaving a permutation of the batch that the radix sort can pick up from
+    bool InsertionSort(size_t count, size_t shiftBudget) {
+        size_t shifts = 0;
+        for (size_t i = 1; i < count; i++) {
+            uint32_t key = keys[i], value = values[i];
+            size_t j = i;
+            for (; j > 0 && keys[j - 1] > key; j--) {
+                keys[j] = keys[j - 1];
+                values[j] = values[j - 1];
+            }
+            keys[j] = key;
+            values[j] = value;
+            shifts += i - j;
+            if (shifts > shiftBudget)
+                return false;
+        }
+        return true;
+    }
+
+public:
+    //fills order with triangle indices, farthest first, starting from last frame's order when the batch looks the same
+    void Sort(const std::vector<Triangle>& triangles, std::vector<uint32_t>& order) {
+        size_t count = triangles.size();
+        keys.resize(count);
+        values.resize(count);
+
+        bool coherent = previousOrder.size() == count;
+        for (size_t i = 0; i < count; i++) {
+            values[i] = coherent ? previousOrder[i] : (uint32_t)i;
+            keys[i] = MakeKey(triangles[values[i]]);
+        }
+
+        if (mode == Mode::COMPARISON) {
+            std::vector<std::pair<uint32_t, uint32_t>> pairs(count);
+            for (size_t i = 0; i < count; i++)
+                pairs[i] = { keys[i], values[i] };
+            std::sort(pairs.begin(), pairs.end());
+            for (size_t i = 0; i < count; i++) {
+                keys[i] = pairs[i].first;
+                values[i] = pairs[i].second;
+            }
+        }
+        else {
+            //a nearly sorted batch is finished off by insertion sort, which is linear when little has moved since last frame
+            size_t descents = 0;
+            for (size_t i = 1; i < count; i++)
+                descents += keys[i] < keys[i - 1];
+
+            if (descents > 0 && (descents > count / 64 || !InsertionSort(count, count * 4)))
+                RadixSort(count);
+        }
+
+        order.assign(values.begin(), values.end());
+        previousOrder = order;
+    }
+};
+
+template <typename T>
+class AssetHandle { //handle to an asset loading in the background, a placeholder stands in for it until it arrives
+
+public:
+    AssetHandle() = default;
+    AssetHandle(std::shared_future<std::shared_ptr<T>> future, std::shared_ptr<T> placeholder) : future(std::move(future)), placeholder(std::move(placeholder)) {}
+
+    bool IsReady() const {
+        return future.valid() && future.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+    }
+
+    //loading finished without producing the asset, the placeholder stays
+    bool Failed() const {
+        return IsReady() && !future.get();
+    }
+
+    T* Get() const {
+        if (IsReady() && future.get())
+            return future.get().get();
+        return placeholder.get();
+    }
+
+    //blocks until loading finishes and returns whether it worked, decals only finish in AssetManager::Update so never wait for one on the thread calling it
+    bool Wait() const {
+        return future.valid() && future.get() != nullptr;
+    }
+
+private:
+    std::shared_future<std::shared_ptr<T>> future;
+    std::shared_ptr<T> placeholder;
+};
+
+class AssetManager { //loads and decodes sprites and meshes on worker threads, decal texture uploads are then spread over frames by Update
+
+public:
+    struct CacheStats {
+        size_t hits = 0, misses = 0;
+        size_t deduplicated = 0; //loads that found the same content already resident under another path
+        size_t evictions = 0;
+        size_t bytesResident = 0, assetsResident = 0;
+    };
+
+    AssetManager(int workerCount = 0) {
+        if (workerCount <= 0)
+            workerCount = (int)std::max(2u, std::thread::hardware_concurrency()) - 1;
+        for (int i = 0; i < workerCount; i++)
+            workers.emplace_back(&AssetManager::Work, this);
+
+        //a magenta and black checkerboard, hard to mistake for the real thing
+        placeholderSprite = std::make_shared<olc::Sprite>(8, 8);
+        for (int y = 0; y < 8; y++)
+            for (int x = 0; x < 8; x++)
+                placeholderSprite->SetPixel(x, y, ((x ^ y) & 4) ? olc::MAGENTA : olc::BLACK);
+
+        placeholderMesh = std::make_shared<Mesh>();
+        placeholderMesh->triangles = {
+            { 0.0f, 0.0f, 0.0f,    0.0f, 1.0f, 0.0f,    1.0f, 1.0f, 0.0f },
+            { 0.0f, 0.0f, 0.0f,    1.0f, 1.0f, 0.0f,    1.0f, 0.0f, 0.0f },
+            { 1.0f, 0.0f, 0.0f,    1.0f, 1.0f, 0.0f,    1.0f, 1.0f, 1.0f },
+            { 1.0f, 0.0f, 0.0f,    1.0f, 1.0f, 1.0f,    1.0f, 0.0f, 1.0f },
+            { 1.0f, 0.0f, 1.0f,    1.0f, 1.0f, 1.0f,    0.0f, 1.0f, 1.0f },
+            { 1.0f, 0.0f, 1.0f,    0.0f, 1.0f, 1.0f,    0.0f, 0.0f, 1.0f },
+            { 0.0f, 0.0f, 1.0f,    0.0f, 1.0f, 1.0f,    0.0f, 1.0f, 0.0f },
+            { 0.0f, 0.0f, 1.0f,    0.0f, 1.0f, 0.0f,    0.0f, 0.0f, 0.0f },
+            { 0.0f, 1.0f, 0.0f,    0.0f, 1.0f, 1.0f,    1.0f, 1.0f, 1.0f },
+            { 0.0f, 1.0f, 0.0f,    1.0f, 1.0f, 1.0f,    1.0f, 1.0f, 0.0f },
+            { 1.0f, 0.0f, 1.0f,    0.0f, 0.0f, 1.0f,    0.0f, 0.0f, 0.0f },
+            { 1.0f, 0.0f, 1.0f,    0.0f, 0.0f, 0.0f,    1.0f, 0.0f, 0.0f }
+        };
+        placeholderMesh->BuildIndexedVertices();
+        placeholderMesh->BuildLevelsOfDetail(1);
+    }
+
+    ~AssetManager() {
+        {
+            std::lock_guard<std::mutex> lock(jobMutex);
+            stopping = true;
+        }
+        jobAvailable.notify_all();
+        for (auto& worker : workers)
+            worker.join();
+
+        //decals that never got uploaded resolve as failed rather than leaving their handles with a broken promise
+        for (auto& upload : pendingUploads)
+            upload.promise->set_value(nullptr);
+    }
+
+    //sprites and meshes are cached, asking again for a path, or for a different path holding the same bytes, shares the one copy.
+    //Every load is a job for the pool, so asking for a whole set of sprites at once decodes them in parallel
+    AssetHandle<olc::Sprite> LoadSprite(const std::string& path, olc::ResourcePack* pack = nullptr) {
+        std::string key = pack ? std::to_string((uintptr_t)pack) + ":" + path : path;
+        std::string rawDirectory = rawSpriteDirectory;
+        return LoadCached<olc::Sprite>("sprite", key, placeholderSprite,
+            [path, pack](std::vector<char>& bytes) { return ReadAsset(path, pack, bytes); },
+            [rawDirectory](const std::vector<char>& bytes, uint64_t hash) { return DecodeSprite(bytes, hash, rawDirectory); });
+    }
+
+    AssetHandle<Mesh> LoadMesh(const std::string& path) {
+        return LoadCached<Mesh>("mesh", path, placeholderMesh,
+            [path](std::vector<char>& bytes) { return ReadAsset(path, nullptr, bytes); },
+            [](const std::vector<char>& bytes, uint64_t) {
+                auto mesh = std::make_shared<Mesh>();
+                std::istringstream stream(std::string(bytes.begin(), bytes.end()));
+                return mesh->LoadObjectFromStream(stream) ? mesh : nullptr;
+            });
+    }
+
+    //keeps the decoded pixels of every sprite loaded from now on in this directory, named by content hash, so loading the same image
+    //again later, even in another run, is a straight read rather than a decode. An empty directory turns it off
+    void SetRawSpriteDirectory(const std::string& directory) {
+        rawSpriteDirectory = directory;
+    }
+
+    //cached assets nothing holds a handle to any more are evicted least recently used first while the cache is over budget
+    void SetCacheBudget(size_t bytes) {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        cacheBudget = bytes;
+        TrimCache();
+    }
+
+    CacheStats GetCacheStats() {
+        std::lock_guard<std::mutex> lock(cacheMutex);
+        return cacheStats;
+    }
+
+    //decoded on a worker like a sprite, then uploaded by Update, so call it from the thread that owns the renderer
+    AssetHandle<olc::Decal> LoadDecal(const std::string& path, olc::ResourcePack* pack = nullptr, bool filter = false, bool clamp = true) {
+        if (!placeholderDecal)
+            placeholderDecal = std::make_shared<olc::Decal>(placeholderSprite.get());
+
+        auto promise = std::make_shared<std::promise<std::shared_ptr<olc::Decal>>>();
+        AssetHandle<olc::Decal> handle(promise->get_future().share(), placeholderDecal);
+        Enqueue([this, promise, path, pack, filter, clamp]() {
+            std::vector<char> bytes;
+            std::shared_ptr<olc::Sprite> sprite = ReadAsset(path, pack, bytes) ? DecodeSprite(bytes) : nullptr;
+            if (!sprite) {
+                promise->set_value(nullptr);
+                return;
+            }
+            std::lock_guard<std::mutex> lock(uploadMutex);
+            pendingUploads.push_back({ sprite, promise, filter, clamp });
+        });
+        return handle;
+    }
+
+    //uploads decoded decals, call once a frame from the thread that owns the renderer. At most maxUploads decals and maxUploadPixels
+    //worth of texture go up per call so streaming doesn't show in the frame time, but always at least one so a big texture still gets through
+    int Update(int maxUploads = 2, size_t maxUploadPixels = 1 << 20) {
+        {
+            //handles dropped since the last call may have freed up assets to evict
+            std::lock_guard<std::mutex> lock(cacheMutex);
+            TrimCache();
+        }
+
+        int uploaded = 0;
+        size_t pixels = 0;
+        while (uploaded < maxUploads) {
+            PendingUpload upload;
+            {
+                std::lock_guard<std::mutex> lock(uploadMutex);
+                if (pendingUploads.empty())
+                    break;
+                size_t size = (size_t)pendingUploads.front().sprite->width * pendingUploads.front().sprite->height;
+                if (uploaded > 0 && pixels + size > maxUploadPixels)
+                    break;
+                upload = std::move(pendingUploads.front());
+                pendingUploads.pop_front();
+                pixels += size;
+            }
+
+            //a decal only points at its sprite, so the deleter keeps the sprite alive for as long as the decal
+            std::shared_ptr<olc::Sprite> sprite = upload.sprite;
+            std::shared_ptr<olc::Decal> decal(new olc::Decal(sprite.get(), upload.filter, upload.clamp), [sprite](olc::Decal* d) { delete d; });
+            upload.promise->set_value(decal);
+            uploaded++;
+        }
+        return uploaded;
+    }
+
+private:
+    struct PendingUpload {
+        std::shared_ptr<olc::Sprite> sprite;
+        std::shared_ptr<std::promise<std::shared_ptr<olc::Decal>>> promise;
+        bool filter = false, clamp = true;
+    };
+
+    std::vector<std::thread> workers;
+    std::queue<std::function<void()>> jobs;
+    std::mutex jobMutex;
+    std::condition_variable jobAvailable;
+    bool stopping = false;
+
+    std::mutex uploadMutex;
+    std::deque<PendingUpload> pendingUploads;
+
+    std::string rawSpriteDirectory;
+    std::shared_ptr<olc::Sprite> placeholderSprite;
+    std::shared_ptr<olc::Decal> placeholderDecal;
+    std::shared_ptr<Mesh> placeholderMesh;
+
+    struct CacheEntry {
+        std::vector<std::string> keys; //every path that turned out to hold this content
+        uint64_t contentHash = 0;
+        std::shared_ptr<void> asset; //set once loaded, handles share it through their futures so its use count is how many are still out
+        std::shared_ptr<void> pending; //the shared_future handed out while loading
+        size_t bytes = 0;
+        bool merged = false; //found to duplicate another entry's content and folded into it
+        std::list<std::shared_ptr<CacheEntry>>::iterator recent;
+    };
+
+    //cacheMutex guards everything below
+    std::mutex cacheMutex;
+    std::unordered_map<std::string, std::shared_ptr<CacheEntry>> cacheByKey;
+    std::unordered_map<uint64_t, std::shared_ptr<CacheEntry>> cacheByContent;
+    std::list<std::shared_ptr<CacheEntry>> recentlyUsed; //most recently used first
+    size_t cacheBudget = 256 << 20;
+    CacheStats cacheStats;
+
+    template <typename T>
+    static std::shared_future<std::shared_ptr<T>> MakeReadyFuture(std::shared_ptr<T> asset) {
+        std::promise<std::shared_ptr<T>> promise;
+        promise.set_value(std::move(asset));
+        return promise.get_future().share();
+    }
+
+    //read fetches the bytes the cache hashes, decode makes the asset from them. Both run on a worker
+    template <typename T>
+    AssetHandle<T> LoadCached(const std::string& type, const std::string& path, const std::shared_ptr<T>& placeholder,
+                              std::function<bool(std::vector<char>&)> read, std::function<std::shared_ptr<T>(const std::vector<char>&, uint64_t)> decode) {
+        std::string key = type + ":" + path;
+        std::lock_guard<std::mutex> lock(cacheMutex);
+
+        auto found = cacheByKey.find(key);
+        if (found != cacheByKey.end()) {
+            std::shared_ptr<CacheEntry> entry = found->second;
+            cacheStats.hits++;
+            recentlyUsed.splice(recentlyUsed.begin(), recentlyUsed, entry->recent);
+            if (entry->asset)
+                return AssetHandle<T>(MakeReadyFuture(std::static_pointer_cast<T>(entry->asset)), placeholder);
+            return AssetHandle<T>(*std::static_pointer_cast<std::shared_future<std::shared_ptr<T>>>(entry->pending), placeholder);
+        }
+
+        cacheStats.misses++;
+        auto entry = std::make_shared<CacheEntry>();
+        auto promise = std::make_shared<std::promise<std::shared_ptr<T>>>();
+        auto future = std::make_shared<std::shared_future<std::shared_ptr<T>>>(promise->get_future().share());
+        entry->keys.push_back(key);
+        entry->pending = future;
+        cacheByKey[key] = entry;
+        recentlyUsed.push_front(entry);
+        entry->recent = recentlyUsed.begin();
+
+        Enqueue([this, type, entry, promise, read, decode]() {
+            std::vector<char> bytes;
+            std::shared_ptr<T> asset;
+            uint64_t hash = 0;
+
+            //returns the resident asset with the same content, folding this entry into its entry
+            auto findDuplicate = [&]() -> std::shared_ptr<T> {
+                auto same = cacheByContent.find(hash);
+                if (same == cacheByContent.end())
+                    return nullptr;
+                MergeEntry(*entry, same->second);
+                cacheStats.deduplicated++;
+                return std::static_pointer_cast<T>(same->second->asset);
+            };
+
+            if (read(bytes)) {
+                hash = HashContent(type, bytes);
+                {
+                    std::lock_guard<std::mutex> lock(cacheMutex);
+                    asset = findDuplicate();
+                }
+                if (!asset)
+                    asset = decode(bytes, hash);
+            }
+
+            {
+                std::lock_guard<std::mutex> lock(cacheMutex);
+                if (!asset) {
+                    //failed loads aren't kept, so asking again retries them
+                    RemoveEntry(*entry);
+                }
+                else if (!entry->merged) {
+                    //the same content under another path may have finished decoding first
+                    if (std::shared_ptr<T> duplicate = findDuplicate()) {
+                        asset = duplicate;
+                    }
+                    else {
+                        entry->asset = asset;
+                        entry->pending.reset();
+                        entry->contentHash = hash;
+                        entry->bytes = AssetBytes(*asset);
+                        cacheByContent[hash] = entry;
+                        cacheStats.bytesResident += entry->bytes;
+                        cacheStats.assetsResident++;
+                        TrimCache();
+                    }
+                }
+            }
+            promise->set_value(asset);
+        });
+
+        return AssetHandle<T>(*future, placeholder);
+    }
+
+    void MergeEntry(CacheEntry& entry, const std::shared_ptr<CacheEntry>& into) {
+        for (auto& key : entry.keys) {
+            cacheByKey[key] = into;
+            into->keys.push_back(key);
+        }
+        recentlyUsed.erase(entry.recent);
+        recentlyUsed.splice(recentlyUsed.begin(), recentlyUsed, into->recent);
+        entry.merged = true;
+    }
+
+    void RemoveEntry(CacheEntry& entry) {
+        for (auto& key : entry.keys)
+            cacheByKey.erase(key);
+        if (entry.asset) {
+            cacheByContent.erase(entry.contentHash);
+            cacheStats.bytesResident -= entry.bytes;
+            cacheStats.assetsResident--;
+        }
+        recentlyUsed.erase(entry.recent);
+    }
+
+    //called with cacheMutex held, assets still loading or with handles out are never evicted
+    void TrimCache() {
+        for (auto it = recentlyUsed.end(); cacheStats.bytesResident > cacheBudget && it != recentlyUsed.begin();) {
+            std::shared_ptr<CacheEntry> entry = *--it;
+            if (!entry->asset || entry->asset.use_count() > 1)
+                continue;
+            it = std::next(it);
+            RemoveEntry(*entry);
+            cacheStats.evictions++;
+        }
+    }
+
+    //64 bit FNV-1a, seeded with the type so a sprite and a mesh never share an entry
+    static uint64_t HashContent(const std::string& type, const std::vector<char>& bytes) {
+        uint64_t hash = 14695981039346656037ull;
+        for (char c : type)
+            hash = (hash ^ (uint8_t)c) * 1099511628211ull;
+        for (char c : bytes)
+            hash = (hash ^ (uint8_t)c) * 1099511628211ull;
+        return hash;
+    }
+
+    static bool ReadAsset(const std::string& path, olc::ResourcePack* pack, std::vector<char>& bytes) {
+        if (pack) {
+            olc::ResourceBuffer buffer = pack->GetFileBuffer(path);
+            if (!buffer.Valid())
+                return false;
+            bytes.assign(buffer.Data(), buffer.Data() + buffer.Size());
+            return true;
+        }
+        std::ifstream file(path, std::ios::binary);
+        if (!file.is_open())
+            return false;
+        bytes.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        return true;
+    }
+
+    static size_t AssetBytes(const olc::Sprite& sprite) {
+        return sprite.pColData.size() * sizeof(olc::Pixel);
+    }
+
+    static size_t AssetBytes(const Mesh& mesh) {
+        size_t bytes = mesh.triangles.size() * sizeof(Triangle) + (mesh.vertices.size() + mesh.vertexNormals.size()) * sizeof(Vector3d);
+        for (auto& levelOfDetail : mesh.levelsOfDetail)
+            bytes += levelOfDetail.indices.size() * sizeof(int) + levelOfDetail.clusters.size() * sizeof(MeshCluster);
+        return bytes;
+    }
+
+    //decodes the file's bytes as read for hashing, so a sprite is read from disk or its pack only once
+    static std::shared_ptr<olc::Sprite> DecodeSprite(const std::vector<char>& bytes, uint64_t hash = 0, const std::string& rawDirectory = "") {
+        std::string rawPath;
+        if (!rawDirectory.empty()) {
+            char name[32];
+            snprintf(name, sizeof(name), "%016llx.rgba", (unsigned long long)hash);
+            rawPath = rawDirectory + "/" + name;
+            if (auto sprite = LoadRawSprite(rawPath))
+                return sprite;
+        }
+
+        auto sprite = std::make_shared<olc::Sprite>();
+        if (sprite->LoadFromMemory(bytes.data(), bytes.size()) != olc::rcode::OK)
+            return nullptr;
+        if (!rawPath.empty())
+            SaveRawSprite(rawPath, *sprite);
+        return sprite;
+    }
+
+    //raw sprites are "RGBA", the width and height as 32 bit ints, then the pixels as they sit in the sprite
+    static std::shared_ptr<olc::Sprite> LoadRawSprite(const std::string& rawPath) {
+        std::ifstream file(rawPath, std::ios::binary | std::ios::ate);
+        if (!file.is_open())
+            return nullptr;
+        size_t fileSize = (size_t)file.tellg();
+        file.seekg(0);
+
+        char magic[4];
+        int32_t width = 0, height = 0;
+        file.read(magic, 4);
+        file.read((char*)&width, sizeof(width));
+        file.read((char*)&height, sizeof(height));
+        if (!file || memcmp(magic, "RGBA", 4) != 0 || width <= 0 || height <= 0 || fileSize != 12 + (size_t)width * height * sizeof(olc::Pixel))
+            return nullptr;
+
+        auto sprite = std::make_shared<olc::Sprite>(width, height);
+        file.read((char*)sprite->GetData(), (size_t)width * height * sizeof(olc::Pixel));
+        return file ? sprite : nullptr;
+    }
+
+    //written under a name of its own then renamed into place, so a worker reading it never sees half a file
+    static void SaveRawSprite(const std::string& rawPath, const olc::Sprite& sprite) {
+        std::string temporaryPath = rawPath + "." + std::to_string(std::hash<std::thread::id>()(std::this_thread::get_id())) + ".tmp";
+        bool written = false;
+        {
+            std::ofstream file(temporaryPath, std::ios::binary);
+            if (!file.is_open())
+                return;
+            int32_t width = sprite.width, height = sprite.height;
+            file.write("RGBA", 4);
+            file.write((const char*)&width, sizeof(width));
+            file.write((const char*)&height, sizeof(height));
+            file.write((const char*)sprite.pColData.data(), sprite.pColData.size() * sizeof(olc::Pixel));
+            written = (bool)file;
+        }
+        //on Windows rename fails when another load of the same content got there first, the copy already cached is just as good
+        if (!written || std::rename(temporaryPath.c_str(), rawPath.c_str()) != 0)
+            std::remove(temporaryPath.c_str());
+    }
+
+    void Enqueue(std::function<void()> job) {
+        {
+            std::lock_guard<std::mutex> lock(jobMutex);
+            jobs.push(std::move(job));
+        }
+        jobAvailable.notify_one();
+    }
+
+    //runs until stopped, finishing whatever is still queued first so every handle resolves
+    void Work() {
+        std::unique_lock<std::mutex> lock(jobMutex);
+        while (true) {
+            jobAvailable.wait(lock, [this] { return stopping || !jobs.empty(); });
+            if (jobs.empty())
+                return;
+            std::function<void()> job = std::move(jobs.front());
+            jobs.pop();
+            lock.unlock();
+            job();
+            lock.lock();
+        }
+    }
+};
+
+class GrahpicsEngine : public olc::PixelGameEngine {
+
+private:
+    AssetManager assets;
+    AssetHandle<Mesh> meshModel; //streamed in, the placeholder cube is drawn until it arrives
+    bool meshModelPlaced = false;
+    Mesh meshFloor;
+    Matrix4x4 projectionMatrix;
+
+    //simulation state is stepped at a fixed rate and drawn blended between the last two steps, so slow frames don't change how it moves
+    float simulationRate = 60.0f; //steps per second, 0 steps once per drawn frame by the frame time instead
+    float frameRateLimit = 144.0f; //frames per second, 0 draws as fast as possible
+    float theta = 0.0f;
+    float previousTheta = 0.0f;
+    float lodPixelThreshold = 1.0f; //largest on screen error, in pixels, a level of detail may introduce
+    float nearPlane = 0.1f;
+
+    //occlusion culling against a quarter resolution depth buffer of the biggest nodes on screen
+    bool occlusionCulling = true;
+    int maxOccluders = 8;
+    OcclusionBuffer occlusionBuffer;
+    bool occlusionBufferReady = false;
+    std::vector<std::pair<float, int>> occluders;
+
+    //the view matrix is rebuilt from the camera once a frame, triangles are lit and projected in view space while culling happens in world space
+    Camera camera;
+    Matrix4x4 viewMatrix = MakeIdentityMatrix();
+    Matrix4x4 viewProjectionMatrix;
+    int32_t lastMouseX = 0, lastMouseY = 0;
+
+    //lights are given in world space, each frame AssignLightsToTiles moves them into view space and sorts the local ones into screen tiles
+    //AddLight hands out handles that stay valid until that light is removed, lightSlots maps a handle to its place in lights
+    //(-1 once removed) and lightHandles maps back, so lights stays densely packed and removal is a swap with the last one
+    std::vector<Light> lights;
+    std::vector<int> lightSlots;
+    std::vector<int> lightHandles;
+    int lightTileSize = 32, lightTilesX = 0, lightTilesY = 0;
+
+    //the first shadow casting directional light gets a shadow map, only re-rendered when that light turns or something in the scene moves
+    std::vector<Vector3d> shadowVertices;
+
+    enum class ShadingMode { FLAT, GOURAUD, PHONG };
+    ShadingMode shadingMode = ShadingMode::FLAT;
+
+    struct FramePacket { //struct defining everything the geometry stage hands the raster stage for one frame
+        std::vector<Triangle> trianglesToDraw;
+        std::vector<uint32_t> drawOrder;
+        std::vector<Triangle> transparentTriangles;
+        ShadingMode shadingMode = ShadingMode::FLAT;
+        bool palettized = false;
+
+        //lights in view space, the ones for tile t are lightTileIndices[lightTileOffsets[t]] up to lightTileOffsets[t + 1]
+        std::vector<Light> viewLights;
+        std::vector<int> globalLights;
+        std::vector<int> lightTileOffsets;
+        std::vector<int> lightTileIndices;
+        Matrix4x4 inverseViewMatrix = MakeIdentityMatrix();
+
+        //each packet keeps its own shadow map, so one can be re-rendered while the other is being read
+        ShadowMap shadowMap;
+        int shadowLight = -1;
+        uint64_t shadowMapCasters = 0; //shadowCastersMoved when this map was last rendered
+        Vector3d shadowDirection = { 0, 0, 0 };
+    };
+
+    //geometry is built into one packet and rasterized from the other. With pipelining on, the next frame's geometry is built on a
+    //worker while this frame is rasterized, trading a frame of latency for overlapping the two stages. Packets change hands only
+    //through geometryState, and a thread never touches a packet it doesn't hold. A thread waiting on a state change sleeps on
+    //geometrySignal, so an idle worker or a main thread waiting for one costs no CPU
+    enum GeometryState { GEOMETRY_IDLE, GEOMETRY_REQUESTED, GEOMETRY_DONE, GEOMETRY_EXIT };
+    bool pipelined = false;
+    FramePacket framePackets[2];
+    FramePacket* geometryFrame = &framePackets[0];
+    FramePacket* rasterFrame = &framePackets[0];
+    std::thread geometryThread;
+    std::atomic<int> geometryState{ GEOMETRY_IDLE };
+    std::mutex geometryMutex;
+    std::condition_variable geometrySignal;
+    uint64_t shadowCastersMoved = 1; //bumped by the geometry stage whenever a shadow caster moves, starts ahead of both packets
+    std::vector<float> pendingSimulationSteps; //queued on the main thread, handed to whichever thread builds the next frame
+    std::vector<float> geometrySimulationSteps;
+    float geometryBlend = 1.0f;
+    Frustum viewFrustum; //world space, taken from the combined view and projection matrix
+    SceneGraph scene;
+    BoundingVolumeHierarchy sceneHierarchy;
+    std::vector<int> visibleNodes;
+    int meshNode = -1;
+    int floorNode = -1;
+    int pickedNode = -1;
+    DepthSorter depthSorter;
+
+    //opaque triangles keep painter's order, the depth buffer is there so transparent ones can be hidden by them
+    bool depthTest = true;
+    std::vector<float> depthBuffer;
+
+    //the colour clear can be turned off when the opaque pass is known to cover every pixel, the depth buffer is always cleared
+    bool clearColor = true;
+
+    //lighting goes through the table, palettized mode also rasterizes opaque triangles into one byte per pixel and expands it once at the end
+    ShadeTable shadeTable;
+    bool palettized = false;
+    Palette palette;
+    std::vector<uint8_t> paletteFrame;
+
+    //triangles drawn with a colour alpha below 255 go through order independent transparency instead of the sort
+    std::vector<float> transparencyAccumulation;
+    std::vector<float> transparencyRevealage;
+    int transparencyMinX = INT32_MAX, transparencyMinY = INT32_MAX, transparencyMaxX = -1, transparencyMaxY = -1;
+
+    void MultiplyVectorByMatrix(const Vector3d& input_vector, Vector3d& output_vector, const Matrix4x4& matrix) {
+        output_vector.x = input_vector.x * matrix.matrix[0][0] + input_vector.y * matrix.matrix[1][0] + input_vector.z * matrix.matrix[2][0] + matrix.matrix[3][0];
+        output_vector.y = input_vector.x * matrix.matrix[0][1] + input_vector.y * matrix.matrix[1][1] + input_vector.z * matrix.matrix[2][1] + matrix.matrix[3][1];
+        output_vector.z = input_vector.x * matrix.matrix[0][2] + input_vector.y * matrix.matrix[1][2] + input_vector.z * matrix.matrix[2][2] + matrix.matrix[3][2];
+        float w = input_vector.x * matrix.matrix[0][3] + input_vector.y * matrix.matrix[1][3] + input_vector.z * matrix.matrix[2][3] + matrix.matrix[3][3];
+
+        if (w != 0) {
+            output_vector.x /= w;
+            output_vector.y /= w;
+            output_vector.z /= w;
+        }
+    }
+
+    void ScaleTriangleToScreen(Triangle& triangle) {
+        for (int i = 0; i < 3; i++) {
+            triangle.points[i].x += 1.0f;
+            triangle.points[i].y += 1.0f;
+            triangle.points[i].x *= 0.5f * (float)ScreenWidth();
+            triangle.points[i].y *= 0.5f * (float)ScreenHeight();
+        }
+    }
+
+    void NormalizeVector(Vector3d& input_vector) {
+        float length = sqrtf(input_vector.x * input_vector.x + input_vector.y * input_vector.y + input_vector.z * input_vector.z);
+        input_vector.x /= length;
+        input_vector.y /= length;
+        input_vector.z /= length;
+    }
+
+    olc::Pixel GetShadeFromLight(const Vector3d& light, olc::Pixel color)
+    {
+        return shadeTable.Shade(light, color);
+    }
+
+    //back-face culls and near clips a triangle that's already in view space, the pieces left go on to ProjectTriangle
+    //the normal is the unit view space face normal, vertex normals are only read by the smooth shading modes
+    void SubmitTriangle(Triangle& triangleTranslated, const Vector3d& normal, olc::Pixel color) {
+        //the camera sits at the view space origin
+        if (normal.x * triangleTranslated.points[0].x + normal.y * triangleTranslated.points[0].y + normal.z * triangleTranslated.points[0].z >= 0)
+            return;
+
+        //anything reaching behind the near plane would project through the camera, so it's cut off first
+        Triangle clipped[2];
+        int clippedCount = ClipTriangleToNearPlane(triangleTranslated, nearPlane, clipped);
+        for (int i = 0; i < clippedCount; i++)
+            ProjectTriangle(clipped[i], normal, color);
+    }
+
+    //projects and lights a triangle already culled and clipped in view space, queueing it for drawing
+    void ProjectTriangle(const Triangle& triangleTranslated, const Vector3d& normal, olc::Pixel color) {
+        Triangle triangleProjected;
+        for (int i = 0; i < 3; i++) {
+            MultiplyVectorByMatrix(triangleTranslated.points[i], triangleProjected.points[i], projectionMatrix);
+        }
+        ScaleTriangleToScreen(triangleProjected);
+
+        FramePacket& frame = *geometryFrame;
+        if (frame.shadingMode == ShadingMode::FLAT || color.a < 255) {
+            //flat shading lights the centroid, using the light list of the tile it lands in
+            //translucent triangles are always lit this way since blending only keeps one colour per triangle
+            Vector3d centroid = {
+                (triangleTranslated.points[0].x + triangleTranslated.points[1].x + triangleTranslated.points[2].x) / 3.0f,
+                (triangleTranslated.points[0].y + triangleTranslated.points[1].y + triangleTranslated.points[2].y) / 3.0f,
+                (triangleTranslated.points[0].z + triangleTranslated.points[1].z + triangleTranslated.points[2].z) / 3.0f
+            };
+            float screenX = (triangleProjected.points[0].x + triangleProjected.points[1].x + triangleProjected.points[2].x) / 3.0f;
+            float screenY = (triangleProjected.points[0].y + triangleProjected.points[1].y + triangleProjected.points[2].y) / 3.0f;
+            triangleProjected.color = GetShadeFromLight(EvaluateLighting(frame, centroid, normal, GetLightTile(screenX, screenY)), color);
+        }
+        else if (frame.shadingMode == ShadingMode::GOURAUD) {
+            for (int i = 0; i < 3; i++) {
+                int tile = GetLightTile(triangleProjected.points[i].x, triangleProjected.points[i].y);
+                triangleProjected.colors[i] = GetShadeFromLight(EvaluateLighting(frame, triangleTranslated.points[i], triangleTranslated.normals[i], tile), color);
+            }
+            triangleProjected.color = triangleProjected.colors[0];
+        }
+        else {
+            triangleProjected.color = color;
+            for (int i = 0; i < 3; i++)
+                triangleProjected.normals[i] = triangleTranslated.normals[i];
+        }
+
+        if (color.a < 255)
+            frame.transparentTriangles.push_back(triangleProjected);
+        else
+            frame.trianglesToDraw.push_back(triangleProjected);
+    }
+
+    int GetLightTile(float screenX, float screenY) {
+        int tileX = std::max(0, std::min(lightTilesX - 1, (int)screenX / lightTileSize));
+        int tileY = std::max(0, std::min(lightTilesY - 1, (int)screenY / lightTileSize));
+        return tileY * lightTilesX + tileX;
+    }
+
+    //sums every directional light plus the local lights listed for the tile, as rgb intensities
+    Vector3d EvaluateLighting(const FramePacket& frame, const Vector3d& position, const Vector3d& normal, int tile) {
+        Vector3d total = { 0, 0, 0 };
+        auto addLight = [&](const Light& light, bool shadowed) {
+            Vector3d toLight;
+            float attenuation = light.intensity;
+
+            if (light.type == LightType::DIRECTIONAL) {
+                toLight = { -light.direction.x, -light.direction.y, -light.direction.z };
+            }
+            else {
+                toLight = { light.position.x - position.x, light.position.y - position.y, light.position.z - position.z };
+                float distance2 = toLight.x * toLight.x + toLight.y * toLight.y + toLight.z * toLight.z;
+                if (distance2 >= light.range * light.range)
+                    return;
+                float inverseDistance = 1.0f / sqrtf(std::max(distance2, 1e-8f));
+                toLight = { toLight.x * inverseDistance, toLight.y * inverseDistance, toLight.z * inverseDistance };
+
+                //windowed inverse square falloff, reaching exactly zero at the range
+                float ratio2 = distance2 / (light.range * light.range);
+                float window = std::max(0.0f, 1.0f - ratio2 * ratio2);
+                attenuation *= window * window / (distance2 + 1.0f);
+
+                if (light.type == LightType::SPOT) {
+                    float spotCos = -(toLight.x * light.direction.x + toLight.y * light.direction.y + toLight.z * light.direction.z);
+                    float t = std::max(0.0f, std::min(1.0f, (spotCos - light.spotOuterCos) / std::max(light.spotInnerCos - light.spotOuterCos, 1e-4f)));
+                    attenuation *= t * t * (3.0f - 2.0f * t);
+                }
+            }
+
+            float lambert = normal.x * toLight.x + normal.y * toLight.y + normal.z * toLight.z;
+            if (lambert <= 0.0f || attenuation <= 0.0f)
+                return;
+            if (shadowed) {
+                //the shadow map doesn't follow the camera, so it's looked up in world space
+                Vector3d worldPosition;
+                MultiplyVectorByMatrix(position, worldPosition, frame.inverseViewMatrix);
+                attenuation *= frame.shadowMap.GetVisibility(worldPosition, TransformDirection(normal, frame.inverseViewMatrix));
+                if (attenuation <= 0.0f)
+                    return;
+            }
+            float amount = lambert * attenuation / 255.0f;
+            total = { total.x + light.color.r * amount, total.y + light.color.g * amount, total.z + light.color.b * amount };
+        };
+
+        for (int lightIndex : frame.globalLights)
+            addLight(frame.viewLights[lightIndex], lightIndex == frame.shadowLight);
+        for (int i = frame.lightTileOffsets[tile]; i < frame.lightTileOffsets[tile + 1]; i++)
+            addLight(frame.viewLights[frame.lightTileIndices[i]], false);
+        return total;
+    }
+
+    //bins each point and spot light into the screen tiles its bounding sphere can touch, so shading only loops over nearby lights
+    void AssignLightsToTiles() {
+        FramePacket& frame = *geometryFrame;
+        std::vector<Light>& viewLights = frame.viewLights;
+        std::vector<int>& lightTileOffsets = frame.lightTileOffsets;
+        std::vector<int>& lightTileIndices = frame.lightTileIndices;
+        viewLights = lights;
+        frame.globalLights.clear();
+
+        int tileCount = lightTilesX * lightTilesY;
+        std::vector<std::array<int, 4>> lightRects;
+        std::vector<int> localLights;
+        lightTileOffsets.assign(tileCount + 1, 0);
+
+        for (int i = 0; i < (int)viewLights.size(); i++) {
+            Light& light = viewLights[i];
+            light.direction = TransformDirection(lights[i].direction, viewMatrix);
+            MultiplyVectorByMatrix(lights[i].position, light.position, viewMatrix);
+            if (light.type == LightType::DIRECTIONAL) {
+                NormalizeVector(light.direction);
+                frame.globalLights.push_back(i);
+                continue;
+            }
+            if (light.type == LightType::SPOT)
+                NormalizeVector(light.direction);
+            if (!viewFrustum.IsSphereVisible(lights[i].position, light.range))
+                continue;
+
+            //a sphere crossing the near plane can cover anything, otherwise its box corners bound it on screen
+            std::array<int, 4> rect = { 0, 0, lightTilesX - 1, lightTilesY - 1 };
+            if (light.position.z - light.range > nearPlane) {
+                float minX = INFINITY, minY = INFINITY, maxX = -INFINITY, maxY = -INFINITY;
+                for (int corner = 0; corner < 8; corner++) {
+                    Vector3d v = {
+                        light.position.x + (corner & 1 ? light.range : -light.range),
+                        light.position.y + (corner & 2 ? light.range : -light.range),
+                        light.position.z + (corner & 4 ? light.range : -light.range)
+                    };
+                    float x = (v.x * projectionMatrix.matrix[0][0] / v.z + 1.0f) * 0.5f * (float)ScreenWidth();
+                    float y = (v.y * projectionMatrix.matrix[1][1] / v.z + 1.0f) * 0.5f * (float)ScreenHeight();
+                    minX = std::min(minX, x); maxX = std::max(maxX, x);
+                    minY = std::min(minY, y); maxY = std::max(maxY, y);
+                }
+                rect = {
+                    std::max(0, (int)floorf(minX) / lightTileSize), std::max(0, (int)floorf(minY) / lightTileSize),
+                    std::min(lightTilesX - 1, (int)ceilf(maxX) / lightTileSize), std::min(lightTilesY - 1, (int)ceilf(maxY) / lightTileSize)
+                };
+                if (maxX < 0.0f || maxY < 0.0f || rect[0] > rect[2] || rect[1] > rect[3])
+                    continue;
+            }
+
+            localLights.push_back(i);
+            lightRects.push_back(rect);
+            for (int y = rect[1]; y <= rect[3]; y++) {
+                for (int x = rect[0]; x <= rect[2]; x++)
+                    lightTileOffsets[y * lightTilesX + x + 1]++;
+            }
+        }
+
+        for (int tile = 0; tile < tileCount; tile++)
+            lightTileOffsets[tile + 1] += lightTileOffsets[tile];
+        lightTileIndices.resize(lightTileOffsets[tileCount]);
+
+        std::vector<int> fill(lightTileOffsets.begin(), lightTileOffsets.end() - 1);
+        for (size_t i = 0; i < localLights.size(); i++) {
+            const std::array<int, 4>& rect = lightRects[i];
+            for (int y = rect[1]; y <= rect[3]; y++) {
+                for (int x = rect[0]; x <= rect[2]; x++)
+                    lightTileIndices[fill[y * lightTilesX + x]++] = localLights[i];
+            }
+        }
+    }
+
+    //turns the projected depth written by the rasterizer back into a view space position
+    Vector3d ScreenToView(float screenX, float screenY, float depth) {
+        float viewDepth = projectionMatrix.matrix[3][2] / (depth - projectionMatrix.matrix[2][2]);
+        return {
+            (screenX / (0.5f * (float)ScreenWidth()) - 1.0f) * viewDepth / projectionMatrix.matrix[0][0],
+            (screenY / (0.5f * (float)ScreenHeight()) - 1.0f) * viewDepth / projectionMatrix.matrix[1][1],
+            viewDepth
+        };
+    }
+
+    //culls and queues one transformed copy of a mesh, center and radius are its bounding sphere in world space
+    void DrawMeshInstance(const Mesh& mesh, const Matrix4x4& transform, olc::Pixel color, const Vector3d& center, float radius) {
+        if (mesh.levelsOfDetail.empty() || !viewFrustum.IsSphereVisible(center, radius))
+            return;
+        float scale = GetMaximumScale(transform);
+        float inverseScale = 1.0f / scale;
+        Matrix4x4 modelViewMatrix = MultiplyMatrices(transform, viewMatrix);
+
+        //uniformly scaled meshes keep the cheap path, anything else goes through the normal matrix and is renormalized
+        bool uniformScale = GetMinimumScale(transform) >= scale * 0.999f;
+        Matrix4x4 normalMatrix = uniformScale ? modelViewMatrix : MakeNormalMatrix(modelViewMatrix);
+        auto transformNormal = [&](const Vector3d& input) {
+            Vector3d output = TransformDirection(input, normalMatrix);
+            if (uniformScale)
+                return Vector3d{ output.x * inverseScale, output.y * inverseScale, output.z * inverseScale };
+            NormalizeVector(output);
+            return output;
+        };
+
+        //view depth of the nearest point on the mesh bounds decides how much detail is needed
+        Vector3d viewCenter;
+        MultiplyVectorByMatrix(center, viewCenter, viewMatrix);
+        const MeshLevelOfDetail& levelOfDetail = mesh.levelsOfDetail[SelectLevelOfDetail(mesh, viewCenter.z - radius)];
+
+        for (auto& cluster : levelOfDetail.clusters) {
+            Vector3d clusterCenter;
+            MultiplyVectorByMatrix(cluster.center, clusterCenter, transform);
+            float clusterRadius = cluster.radius * scale;
+            if (!viewFrustum.IsSphereVisible(clusterCenter, clusterRadius))
+                continue;
+            if (occlusionBufferReady) {
+                Vector3d viewClusterCenter;
+                MultiplyVectorByMatrix(clusterCenter, viewClusterCenter, viewMatrix);
+                if (occlusionBuffer.IsSphereOccluded(viewClusterCenter, clusterRadius))
+                    continue;
+            }
+
+            if (cluster.coneCutoff < 1.0f) {
+                Vector3d axis = TransformDirection(cluster.coneAxis, transform);
+                NormalizeVector(axis);
+                Vector3d toCluster = { clusterCenter.x - camera.position.x, clusterCenter.y - camera.position.y, clusterCenter.z - camera.position.z };
+                float distance = sqrtf(toCluster.x * toCluster.x + toCluster.y * toCluster.y + toCluster.z * toCluster.z);
+                if (toCluster.x * axis.x + toCluster.y * axis.y + toCluster.z * axis.z >= cluster.coneCutoff * distance + clusterRadius)
+                    continue;
+            }
+
+            for (int index = cluster.firstIndex; index < cluster.firstIndex + cluster.indexCount; index += 3) {
+                Triangle triangleTranslated = {};
+                for (int i = 0; i < 3; i++)
+                    MultiplyVectorByMatrix(mesh.vertices[levelOfDetail.indices[index + i]], triangleTranslated.points[i], modelViewMatrix);
+
+                //under uniform scale the cached normal only needs rotating, dividing out the scale keeps it unit length without a square root
+                Vector3d normal = transformNormal(levelOfDetail.faceNormals[index / 3]);
+
+                if (geometryFrame->shadingMode != ShadingMode::FLAT) {
+                    for (int i = 0; i < 3; i++)
+                        triangleTranslated.normals[i] = transformNormal(mesh.vertexNormals[levelOfDetail.indices[index + i]]);
+                }
+
+                SubmitTriangle(triangleTranslated, normal, color);
+            }
+        }
+    }
+
+    void ResizeFrameBuffers() {
+        size_t pixels = (size_t)ScreenWidth() * ScreenHeight();
+        depthBuffer.assign(pixels, INFINITY);
+        transparencyAccumulation.assign(pixels * 4, 0.0f);
+        transparencyRevealage.assign(pixels, 1.0f);
+        paletteFrame.assign(pixels, palette.Find(olc::BLACK));
+    }
+
+    void ExpandPalette() {
+        olc::Pixel* frame = GetDrawTarget()->GetData();
+        const olc::Pixel* colors = palette.colors.data();
+        for (size_t pixel = 0; pixel < paletteFrame.size(); pixel++)
+            frame[pixel] = colors[paletteFrame[pixel]];
+    }
+
+    //fills an opaque triangle, keeping the nearest projected depth per pixel so transparent surfaces can be tested against it
+    void RasterizeOpaqueTriangle(const Triangle& triangle) {
+        const FramePacket& frame = *rasterFrame;
+        bool palettized = frame.palettized;
+        int width = ScreenWidth();
+        olc::Pixel* target = GetDrawTarget()->GetData();
+        olc::Pixel color = triangle.color;
+        float z0 = triangle.points[0].z, z1 = triangle.points[1].z, z2 = triangle.points[2].z;
+
+        if (frame.shadingMode == ShadingMode::FLAT && palettized) {
+            uint8_t index = palette.Find(color);
+            RasterizeTriangle(triangle.points, width, ScreenHeight(), [&](int x, int y, float w0, float w1, float w2) {
+                size_t pixel = (size_t)y * width + x;
+                float depth = w0 * z0 + w1 * z1 + w2 * z2;
+                if (depthTest && depth > depthBuffer[pixel])
+                    return;
+                depthBuffer[pixel] = depth;
+                paletteFrame[pixel] = index;
+            });
+        }
+        else if (frame.shadingMode == ShadingMode::FLAT) {
+            RasterizeTriangle(triangle.points, width, ScreenHeight(), [&](int x, int y, float w0, float w1, float w2) {
+                size_t pixel = (size_t)y * width + x;
+                float depth = w0 * z0 + w1 * z1 + w2 * z2;
+                if (depthTest && depth > depthBuffer[pixel])
+                    return;
+                depthBuffer[pixel] = depth;
+                target[pixel] = color;
+            });
+        }
+        else if (frame.shadingMode == ShadingMode::GOURAUD) {
+            const olc::Pixel* colors = triangle.colors;
+            RasterizeTriangle(triangle.points, width, ScreenHeight(), [&](int x, int y, float w0, float w1, float w2) {
+                size_t pixel = (size_t)y * width + x;
+                float depth = w0 * z0 + w1 * z1 + w2 * z2;
+                if (depthTest && depth > depthBuffer[pixel])
+                    return;
+                depthBuffer[pixel] = depth;
+                olc::Pixel shaded(
+                    (uint8_t)(colors[0].r * w0 + colors[1].r * w1 + colors[2].r * w2),
+                    (uint8_t)(colors[0].g * w0 + colors[1].g * w1 + colors[2].g * w2),
+                    (uint8_t)(colors[0].b * w0 + colors[1].b * w1 + colors[2].b * w2));
+                if (palettized)
+                    paletteFrame[pixel] = palette.Find(shaded);
+                else
+                    target[pixel] = shaded;
+            });
+        }
+        else {
+            const Vector3d* normals = triangle.normals;
+            RasterizeTriangle(triangle.points, width, ScreenHeight(), [&](int x, int y, float w0, float w1, float w2) {
+                size_t pixel = (size_t)y * width + x;
+                float depth = w0 * z0 + w1 * z1 + w2 * z2;
+                if (depthTest && depth > depthBuffer[pixel])
+                    return;
+                depthBuffer[pixel] = depth;
+
+                Vector3d normal = {
+                    normals[0].x * w0 + normals[1].x * w1 + normals[2].x * w2,
+                    normals[0].y * w0 + normals[1].y * w1 + normals[2].y * w2,
+                    normals[0].z * w0 + normals[1].z * w1 + normals[2].z * w2
+                };
+                NormalizeVector(normal);
+                Vector3d position = ScreenToView((float)x + 0.5f, (float)y + 0.5f, depth);
+                olc::Pixel shaded = GetShadeFromLight(EvaluateLighting(frame, position, normal, GetLightTile((float)x, (float)y)), color);
+                if (palettized)
+                    paletteFrame[pixel] = palette.Find(shaded);
+                else
+                    target[pixel] = shaded;
+            });
+        }
+    }
+
+    //weighted blended order independent transparency from McGuire & Bavoil, https://jcgt.org/published/0002/02/09/
+    //fragments are accumulated in any order with a weight that favours nearer surfaces, so transparent triangles are never sorted
+    void AccumulateTransparentTriangle(const Triangle& triangle) {
+        int width = ScreenWidth();
+        float alpha = triangle.color.a / 255.0f;
+        float red = triangle.color.r / 255.0f * alpha, green = triangle.color.g / 255.0f * alpha, blue = triangle.color.b / 255.0f * alpha;
+        float z0 = triangle.points[0].z, z1 = triangle.points[1].z, z2 = triangle.points[2].z;
+
+        for (int i = 0; i < 3; i++) {
+            transparencyMinX = std::min(transparencyMinX, std::max(0, (int)floorf(triangle.points[i].x)));
+            transparencyMaxX = std::max(transparencyMaxX, std::min(width - 1, (int)ceilf(triangle.points[i].x)));
+            transparencyMinY = std::min(transparencyMinY, std::max(0, (int)floorf(triangle.points[i].y)));
+            transparencyMaxY = std::max(transparencyMaxY, std::min(ScreenHeight() - 1, (int)ceilf(triangle.points[i].y)));
+        }
+
+        RasterizeTriangle(triangle.points, width, ScreenHeight(), [&](int x, int y, float w0, float w1, float w2) {
+            size_t pixel = (size_t)y * width + x;
+            float depth = w0 * z0 + w1 * z1 + w2 * z2;
+            if (depth > depthBuffer[pixel])
+                return;
+
+            //weight equation 7 from the paper, using view depth recovered from the projected depth
+            float viewDepth = projectionMatrix.matrix[3][2] / (depth - projectionMatrix.matrix[2][2]);
+            float weight = alpha * std::max(1e-2f, std::min(3e3f, 10.0f / (1e-5f + powf(viewDepth / 5.0f, 2.0f) + powf(viewDepth / 200.0f, 6.0f))));
+
+            float* accumulation = &transparencyAccumulation[pixel * 4];
+            accumulation[0] += red * weight;
+            accumulation[1] += green * weight;
+            accumulation[2] += blue * weight;
+            accumulation[3] += alpha * weight;
+            transparencyRevealage[pixel] *= 1.0f - alpha;
+        });
+    }
+
+    //composites the accumulated transparency over the frame in one pass, resetting the buffers only where something was drawn
+    void ResolveTransparency() {
+        if (transparencyMinX > transparencyMaxX || transparencyMinY > transparencyMaxY)
+            return;
+
+        int width = ScreenWidth();
+        olc::Pixel* frame = GetDrawTarget()->GetData();
+        for (int y = transparencyMinY; y <= transparencyMaxY; y++) {
+            for (int x = transparencyMinX; x <= transparencyMaxX; x++) {
+                size_t pixel = (size_t)y * width + x;
+                float revealage = transparencyRevealage[pixel];
+                if (revealage >= 1.0f)
+                    continue;
+
+                float* accumulation = &transparencyAccumulation[pixel * 4];
+                float inverseWeight = 1.0f / std::max(accumulation[3], 1e-5f);
+                float coverage = 1.0f - revealage;
+                olc::Pixel& destination = frame[pixel];
+                destination.r = (uint8_t)std::min(255.0f, accumulation[0] * inverseWeight * 255.0f * coverage + destination.r * revealage);
+                destination.g = (uint8_t)std::min(255.0f, accumulation[1] * inverseWeight * 255.0f * coverage + destination.g * revealage);
+                destination.b = (uint8_t)std::min(255.0f, accumulation[2] * inverseWeight * 255.0f * coverage + destination.b * revealage);
+
+                accumulation[0] = accumulation[1] = accumulation[2] = accumulation[3] = 0.0f;
+                transparencyRevealage[pixel] = 1.0f;
+            }
+        }
+
+        transparencyMinX = transparencyMinY = INT32_MAX;
+        transparencyMaxX = transparencyMaxY = -1;
+    }
+
+    //draws the largest visible nodes into the occlusion buffer, so everything else can be tested against them
+    void RasterizeOccluders(const SceneGraph& scene) {
+        occluders.clear();
+        for (int nodeIndex : visibleNodes) {
+            const SceneNode& node = scene.nodes[nodeIndex];
+            Vector3d viewCenter;
+            MultiplyVectorByMatrix(node.boundsCenter, viewCenter, viewMatrix);
+            float depth = viewCenter.z - node.boundsRadius;
+            if (depth > nearPlane && node.color.a == 255)
+                occluders.push_back({ node.boundsRadius / depth, nodeIndex });
+        }
+        size_t occluderCount = std::min(occluders.size(), (size_t)maxOccluders);
+        std::partial_sort(occluders.begin(), occluders.begin() + occluderCount, occluders.end(), std::greater<std::pair<float, int>>());
+
+        occlusionBuffer.Clear();
+        for (size_t i = 0; i < occluderCount; i++) {
+            const SceneNode& node = scene.nodes[occluders[i].second];
+            const Mesh& mesh = *node.mesh;
+            Vector3d viewCenter;
+            MultiplyVectorByMatrix(node.boundsCenter, viewCenter, viewMatrix);
+            const MeshLevelOfDetail& levelOfDetail = mesh.levelsOfDetail[SelectLevelOfDetail(mesh, viewCenter.z - node.boundsRadius)];
+            Matrix4x4 modelViewMatrix = MultiplyMatrices(node.worldTransform, viewMatrix);
+
+            for (size_t index = 0; index < levelOfDetail.indices.size(); index += 3) {
+                Vector3d v[3];
+                for (int j = 0; j < 3; j++)
+                    MultiplyVectorByMatrix(mesh.vertices[levelOfDetail.indices[index + j]], v[j], modelViewMatrix);
+
+                //only the front faces of a closed mesh are needed to hide what's behind it
+                Vector3d normal = TransformDirection(levelOfDetail.faceNormals[index / 3], modelViewMatrix);
+                if (normal.x * v[0].x + normal.y * v[0].y + normal.z * v[0].z >= 0)
+                    continue;
+
+                occlusionBuffer.RasterizeOccluder(v[0], v[1], v[2]);
+            }
+        }
+        occlusionBuffer.BuildPyramid();
+        occlusionBufferReady = occluderCount > 0;
+    }
+
+    //picks the coarsest level whose error, projected to the screen at this view depth, stays under lodPixelThreshold
+    int SelectLevelOfDetail(const Mesh& mesh, float viewDepth) {
+        if (mesh.levelsOfDetail.empty() || viewDepth <= 0.0f)
+            return 0;
+
+        float pixelsPerUnit = 0.5f * (float)ScreenHeight() * projectionMatrix.matrix[1][1] / viewDepth;
+        int level = 0;
+        for (int i = 1; i < (int)mesh.levelsOfDetail.size(); i++) {
+            if (mesh.levelsOfDetail[i].error * pixelsPerUnit > lodPixelThreshold)
+                break;
+            level = i;
+        }
+        return level;
+    }
+
+    //WASD moves, Q and E drop and rise, the arrow keys or dragging with the right mouse button turn
+    void UpdateCamera(float elapsedTime) {
+        float forward = 0.0f, right = 0.0f, up = 0.0f;
+        if (GetKey(olc::Key::W).bHeld) forward += 1.0f;
+        if (GetKey(olc::Key::S).bHeld) forward -= 1.0f;
+        if (GetKey(olc::Key::D).bHeld) right += 1.0f;
+        if (GetKey(olc::Key::A).bHeld) right -= 1.0f;
+        if (GetKey(olc::Key::E).bHeld) up += 1.0f;
+        if (GetKey(olc::Key::Q).bHeld) up -= 1.0f;
+        float distance = camera.moveSpeed * elapsedTime;
+        camera.Move(forward * distance, right * distance, up * distance);
+
+        float yawChange = 0.0f, pitchChange = 0.0f;
+        if (GetKey(olc::Key::RIGHT).bHeld) yawChange += camera.turnSpeed * elapsedTime;
+        if (GetKey(olc::Key::LEFT).bHeld) yawChange -= camera.turnSpeed * elapsedTime;
+        if (GetKey(olc::Key::UP).bHeld) pitchChange += camera.turnSpeed * elapsedTime;
+        if (GetKey(olc::Key::DOWN).bHeld) pitchChange -= camera.turnSpeed * elapsedTime;
+        if (GetMouse(olc::Mouse::RIGHT).bHeld && !GetMouse(olc::Mouse::RIGHT).bPressed) {
+            yawChange += (GetMouseX() - lastMouseX) * camera.mouseSensitivity;
+            pitchChange -= (GetMouseY() - lastMouseY) * camera.mouseSensitivity;
+        }
+        lastMouseX = GetMouseX();
+        lastMouseY = GetMouseY();
+        camera.Turn(yawChange, pitchChange);
+    }
+
+public:
+    //queues every instance of the mesh for this frame, each one culled by its bounds and clusters and transformed by a single matrix
+    void DrawMeshInstanced(const Mesh& mesh, const std::vector<MeshInstance>& instances) {
+        for (auto& instance : instances) {
+            Vector3d center;
+            MultiplyVectorByMatrix(mesh.boundsCenter, center, instance.transform);
+            DrawMeshInstance(mesh, instance.transform, instance.color, center, mesh.boundsRadius * GetMaximumScale(instance.transform));
+        }
+    }
+
+    //renders every mesh node into the shadow map from the first shadow casting directional light
+    void UpdateShadowMap() {
+        FramePacket& frame = *geometryFrame;
+        ShadowMap& shadowMap = frame.shadowMap;
+        int& shadowLight = frame.shadowLight;
+        shadowLight = -1;
+        for (int i = 0; i < (int)lights.size(); i++) {
+            if (lights[i].type == LightType::DIRECTIONAL && lights[i].castsShadows) {
+                shadowLight = i;
+                break;
+            }
+        }
+        if (shadowLight < 0)
+            return;
+
+        Vector3d direction = lights[shadowLight].direction;
+        NormalizeVector(direction);
+        if (frame.shadowMapCasters == shadowCastersMoved && direction.x == frame.shadowDirection.x && direction.y == frame.shadowDirection.y && direction.z == frame.shadowDirection.z)
+            return;
+        frame.shadowMapCasters = shadowCastersMoved;
+        frame.shadowDirection = direction;
+
+        Vector3d boundsMin = { INFINITY, INFINITY, INFINITY }, boundsMax = { -INFINITY, -INFINITY, -INFINITY };
+        for (auto& node : scene.nodes) {
+            if (!node.mesh)
+                continue;
+            boundsMin = { std::min(boundsMin.x, node.boundsMin.x), std::min(boundsMin.y, node.boundsMin.y), std::min(boundsMin.z, node.boundsMin.z) };
+            boundsMax = { std::max(boundsMax.x, node.boundsMax.x), std::max(boundsMax.y, node.boundsMax.y), std::max(boundsMax.z, node.boundsMax.z) };
+        }
+        shadowMap.Clear();
+        if (boundsMin.x > boundsMax.x)
+            return;
+        shadowMap.Fit(direction, boundsMin, boundsMax);
+
+        for (auto& node : scene.nodes) {
+            if (!node.mesh || node.mesh->levelsOfDetail.empty() || node.color.a < 255)
+                continue;
+
+            shadowVertices.resize(node.mesh->vertices.size());
+            for (size_t i = 0; i < shadowVertices.size(); i++) {
+                Vector3d world;
+                MultiplyVectorByMatrix(node.mesh->vertices[i], world, node.worldTransform);
+                shadowVertices[i] = shadowMap.ToShadowSpace(world);
+            }
+
+            const std::vector<int>& indices = node.mesh->levelsOfDetail[0].indices;
+            for (size_t index = 0; index + 2 < indices.size(); index += 3) {
+                Vector3d points[3] = { shadowVertices[indices[index]], shadowVertices[indices[index + 1]], shadowVertices[indices[index + 2]] };
+                float area = (points[1].x - points[0].x) * (points[2].y - points[0].y) - (points[1].y - points[0].y) * (points[2].x - points[0].x);
+                if (shadowMap.backFacesOnly && area < 0.0f)
+                    continue;
+                shadowMap.RasterizeCaster(points);
+            }
+        }
+    }
+
+    int AddLight(const Light& light) {
+        int handle = (int)lightSlots.size();
+        lightSlots.push_back((int)lights.size());
+        lightHandles.push_back(handle);
+        lights.push_back(light);
+        return handle;
+    }
+
+    //handles are never reused, so removing a light twice or through a stale handle does nothing
+    void RemoveLight(int handle) {
+        if (handle < 0 || handle >= (int)lightSlots.size() || lightSlots[handle] < 0)
+            return;
+        int slot = lightSlots[handle];
+        int last = (int)lights.size() - 1;
+        lights[slot] = lights[last];
+        lightHandles[slot] = lightHandles[last];
+        lightSlots[lightHandles[slot]] = slot;
+        lights.pop_back();
+        lightHandles.pop_back();
+        lightSlots[handle] = -1;
+    }
+
+    Light* GetLight(int handle) {
+        if (handle < 0 || handle >= (int)lightSlots.size() || lightSlots[handle] < 0)
+            return nullptr;
+        return &lights[lightSlots[handle]];
+    }
+
+    //queues the mesh nodes the hierarchy finds in the frustum, using the world transforms and bounds cached by the last UpdateWorldTransforms
+    void DrawScene(const SceneGraph& scene, const BoundingVolumeHierarchy& hierarchy) {
+        visibleNodes.clear();
+        hierarchy.CullFrustum(viewFrustum, visibleNodes);
+
+        if (occlusionCulling)
+            RasterizeOccluders(scene);
+
+        for (int nodeIndex : visibleNodes) {
+            const SceneNode& node = scene.nodes[nodeIndex];
+            if (occlusionBufferReady) {
+                //the cached box is axis aligned in world space, its bounding sphere is the cheapest conservative shape in view space
+                Vector3d viewCenter;
+                MultiplyVectorByMatrix(node.boundsCenter, viewCenter, viewMatrix);
+                if (occlusionBuffer.IsSphereOccluded(viewCenter, node.boundsRadius))
+                    continue;
+            }
+            DrawMeshInstance(*node.mesh, node.worldTransform, node.color, node.boundsCenter, node.boundsRadius);
+        }
+    }
+
+    //scene node under the given screen pixel, or -1 when the ray through it misses everything
+    int PickSceneNode(const SceneGraph& scene, const BoundingVolumeHierarchy& hierarchy, int32_t screenX, int32_t screenY) {
+        //undo ScaleTriangleToScreen and the projection, which leaves a direction through the pixel at a view depth of 1
+        Vector3d viewDirection;
+        viewDirection.x = ((float)screenX / (0.5f * (float)ScreenWidth()) - 1.0f) / projectionMatrix.matrix[0][0];
+        viewDirection.y = ((float)screenY / (0.5f * (float)ScreenHeight()) - 1.0f) / projectionMatrix.matrix[1][1];
+        viewDirection.z = 1.0f;
+
+        Ray ray;
+        ray.origin = camera.position;
+        ray.direction = TransformDirection(viewDirection, InvertAffineMatrix(camera.GetViewMatrix()));
+
+        float hitDistance;
+        return hierarchy.Raycast(scene, ray, hitDistance);
+    }
+
+    void Simulate(float timeStep) {
+        previousTheta = theta;
+        theta += 1.0f * timeStep;
+    }
+
+    //a floor just under the mesh to catch its shadow, y points down the screen and the mesh is flipped by its rotation
+    void BuildFloor(const Mesh& mesh) {
+        float floorHeight = 1.0f - mesh.boundsMin.y;
+        float floorExtent = 4.0f * mesh.boundsRadius + 4.0f;
+        const int floorCells = 32;
+        meshFloor.triangles.clear();
+        for (int z = 0; z < floorCells; z++) {
+            for (int x = 0; x < floorCells; x++) {
+                float x0 = -floorExtent + 2.0f * floorExtent * x / floorCells, x1 = -floorExtent + 2.0f * floorExtent * (x + 1) / floorCells;
+                float z0 = 2.0f * floorExtent * z / floorCells, z1 = 2.0f * floorExtent * (z + 1) / floorCells;
+                meshFloor.triangles.push_back({ x0, floorHeight, z0,    x1, floorHeight, z1,    x0, floorHeight, z1 });
+                meshFloor.triangles.push_back({ x0, floorHeight, z0,    x1, floorHeight, z0,    x1, floorHeight, z1 });
+            }
+        }
+        meshFloor.BuildIndexedVertices();
+        meshFloor.BuildLevelsOfDetail(1);
+    }
+
+    //swaps streamed in assets into the scene, on the main thread between frames like input. A model that fails to load leaves its placeholder
+    void UpdateAssets() {
+        assets.Update();
+        if (meshModelPlaced || !meshModel.IsReady())
+            return;
+        meshModelPlaced = true;
+        if (meshModel.Failed())
+            return;
+
+        scene.SetMesh(meshNode, meshModel.Get());
+        BuildFloor(*meshModel.Get());
+        scene.SetMesh(floorNode, &meshFloor);
+        scene.UpdateWorldTransforms();
+        sceneHierarchy.Build(scene);
+        shadowCastersMoved++;
+    }
+
+    //input is read on the main thread between frames, while no geometry is being built
+    void HandleInput(float elapsedTime) {
+        UpdateCamera(elapsedTime);
+
+        if (GetKey(olc::Key::K1).bPressed)
+            shadingMode = ShadingMode::FLAT;
+        if (GetKey(olc::Key::K2).bPressed)
+            shadingMode = ShadingMode::GOURAUD;
+        if (GetKey(olc::Key::K3).bPressed)
+            shadingMode = ShadingMode::PHONG;
+        if (GetKey(olc::Key::P).bPressed)
+            palettized = !palettized;
+        if (GetKey(olc::Key::T).bPressed)
+            pipelined = !pipelined;
+        if (GetKey(olc::Key::C).bPressed)
+            clearColor = !clearColor;
+
+        if (GetMouse(olc::Mouse::LEFT).bPressed) {
+            if (pickedNode >= 0)
+                scene.nodes[pickedNode].color = olc::WHITE;
+            pickedNode = PickSceneNode(scene, sceneHierarchy, GetMouseX(), GetMouseY());
+            if (pickedNode >= 0)
+                scene.nodes[pickedNode].color = olc::YELLOW;
+        }
+    }
+
+    //simulation and geometry stage, steps the simulation then culls, lights and sorts the scene into geometryFrame
+    void BuildFrame(const std::vector<float>& simulationSteps, float blend) {
+        FramePacket& frame = *geometryFrame;
+        for (float timeStep : simulationSteps)
+            Simulate(timeStep);
+        float drawnTheta = previousTheta + (theta - previousTheta) * blend;
+
+        frame.shadingMode = shadingMode;
+        frame.palettized = palettized;
+        frame.trianglesToDraw.clear();
+        frame.transparentTriangles.clear();
+        occlusionBufferReady = false;
+
+        scene.SetLocalTransform(meshNode, MultiplyMatrices(MultiplyMatrices(MakeRotationMatrixX(0), MakeRotationMatrixY(drawnTheta)), MakeTranslationMatrix(0.0f, 1.0f, 2.0f)));
+        if (scene.UpdateWorldTransforms() > 0) {
+            sceneHierarchy.Refit(scene);
+            shadowCastersMoved++;
+        }
+
+        viewMatrix = camera.GetViewMatrix();
+        frame.inverseViewMatrix = InvertAffineMatrix(viewMatrix);
+        viewProjectionMatrix = MultiplyMatrices(viewMatrix, projectionMatrix);
+        viewFrustum = Frustum::FromMatrix(viewProjectionMatrix);
+
+        UpdateShadowMap();
+        AssignLightsToTiles();
+        DrawScene(scene, sceneHierarchy);
+
+        depthSorter.Sort(frame.trianglesToDraw, frame.drawOrder);
+    }
+
+    //raster stage, draws rasterFrame into the draw target
+    void RasterizeFrame() {
+        const FramePacket& frame = *rasterFrame;
+
+        //the palette expansion rewrites every pixel, so only the byte buffer needs clearing in that mode
+        if (frame.palettized)
+            std::fill(paletteFrame.begin(), paletteFrame.end(), palette.Find(olc::BLACK));
+        ClearTargets(olc::BLACK, clearColor && !frame.palettized);
+
+        for (uint32_t triangleIndex : frame.drawOrder) {
+            RasterizeOpaqueTriangle(frame.trianglesToDraw[triangleIndex]);
+        }
+        if (frame.palettized)
+            ExpandPalette();
+
+        for (auto& triangleProjected : frame.transparentTriangles) {
+            AccumulateTransparentTriangle(triangleProjected);
+        }
+        ResolveTransparency();
+    }
+
+    //one call for both per frame clears, the colour fill goes through the vectorized Clear rather than per pixel Draw calls
+    void ClearTargets(olc::Pixel color, bool clearColorTarget) {
+        if (clearColorTarget)
+            Clear(color);
+        std::fill(depthBuffer.begin(), depthBuffer.end(), INFINITY);
+    }
+
+    //the store is made under the mutex so a waiter can't check the state and then miss the notify
+    void SetGeometryState(int state) {
+        {
+            std::lock_guard<std::mutex> lock(geometryMutex);
+            geometryState.store(state, std::memory_order_release);
+        }
+        geometrySignal.notify_all();
+    }
+
+    template <typename Predicate>
+    int WaitForGeometryState(Predicate ready) {
+        int state = geometryState.load(std::memory_order_acquire);
+        if (ready(state))
+            return state;
+        std::unique_lock<std::mutex> lock(geometryMutex);
+        geometrySignal.wait(lock, [&] { return ready(state = geometryState.load(std::memory_order_acquire)); });
+        return state;
+    }
+
+    //sleeps between frames, the packet itself still changes hands through the atomic state
+    void GeometryWorker() {
+        while (true) {
+            int state = WaitForGeometryState([](int s) { return s == GEOMETRY_REQUESTED || s == GEOMETRY_EXIT; });
+            if (state == GEOMETRY_EXIT)
+                return;
+
+            BuildFrame(geometrySimulationSteps, geometryBlend);
+            geometrySimulationSteps.clear();
+            SetGeometryState(GEOMETRY_DONE);
+        }
+    }
+
+    //any frame still being built is finished and thrown away
+    void StopGeometryThread() {
+        if (!geometryThread.joinable())
+            return;
+        WaitForGeometryState([](int s) { return s != GEOMETRY_REQUESTED; });
+        SetGeometryState(GEOMETRY_EXIT);
+        geometryThread.join();
+        geometryState.store(GEOMETRY_IDLE, std::memory_order_relaxed);
+    }
+
+    GrahpicsEngine() {
+        sAppName = "Cube Demo";
+    }
+
+    bool OnUserCreate() override {
+        meshModel = assets.LoadMesh("peter_griffin.obj");
+
+        float zNear = nearPlane;
+        float zFar = 1000.0f;
+        float fieldOfView = 90.0f;
+        float aspectRatio = (float)ScreenHeight() / (float)ScreenWidth();
+        float fovRadians = 1.0f / tanf(fieldOfView * 0.5f / 180.0f * M_PI);
+
+        projectionMatrix.matrix[0][0] = aspectRatio * fovRadians;
+        projectionMatrix.matrix[1][1] = fovRadians;
+        projectionMatrix.matrix[2][2] = zFar / (zFar - zNear);
+        projectionMatrix.matrix[3][2] = (-zFar * zNear) / (zFar - zNear);
+        projectionMatrix.matrix[2][3] = 1.0f;
+        projectionMatrix.matrix[3][3] = 0.0f;
+
+        viewProjectionMatrix = MultiplyMatrices(viewMatrix, projectionMatrix);
+        viewFrustum = Frustum::FromMatrix(viewProjectionMatrix);
+        lightTilesX = (ScreenWidth() + lightTileSize - 1) / lightTileSize;
+        lightTilesY = (ScreenHeight() + lightTileSize - 1) / lightTileSize;
+
+        Light sunLight;
+        sunLight.type = LightType::DIRECTIONAL;
+        sunLight.direction = { 0.8f, 1.0f, 0.4f };
+        sunLight.castsShadows = true;
+        AddLight(sunLight);
+
+        //a pair of coloured point lights either side of the mesh
+        Light redLight;
+        redLight.position = { -1.5f, 0.0f, 2.0f };
+        redLight.color = olc::Pixel(255, 80, 40);
+        redLight.intensity = 2.0f;
+        redLight.range = 3.0f;
+        AddLight(redLight);
+
+        Light blueLight = redLight;
+        blueLight.position = { 1.5f, 0.5f, 2.0f };
+        blueLight.color = olc::Pixel(40, 120, 255);
+        AddLight(blueLight);
+
+        if (simulationRate > 0.0f)
+            SetFixedTimestep(1.0f / simulationRate);
+        if (frameRateLimit > 0.0f)
+            SetFrameLimit(1.0f / frameRateLimit);
+
+        occlusionBuffer.Setup(ScreenWidth() / 4, ScreenHeight() / 4, projectionMatrix, zNear);
+        ResizeFrameBuffers();
+        meshNode = scene.AddNode(-1, MakeIdentityMatrix(), meshModel.Get());
+        floorNode = scene.AddNode(-1, MakeIdentityMatrix()); //gets its mesh once the model arrives and there's something to fit it to
+
+        for (auto& frame : framePackets)
+            frame.shadowMap.Setup(1024);
+        scene.UpdateWorldTransforms();
+        sceneHierarchy.Build(scene);
+
+        return true;
+    }
+
+    //simulation steps are only queued here and run with the geometry stage, so a worker building a frame never sees them change
+    bool OnUserFixedUpdate(float fixedTimestep) override {
+        pendingSimulationSteps.push_back(fixedTimestep);
+        return true;
+    }
+
+    bool OnUserDestroy() override {
+        StopGeometryThread();
+        return true;
+    }
+
+    ~GrahpicsEngine() {
+        StopGeometryThread();
+    }
+
+    bool OnUserUpdate(float elapsedTime) override {
+        if (GetFixedTimestep() == 0.0f)
+            pendingSimulationSteps.push_back(elapsedTime);
+        float blend = GetFixedTimestep() > 0.0f ? GetFixedAlpha() : 1.0f;
+
+        //the worker's frame from the last call is collected first, it's the one drawn this time and the worker is idle from here on
+        bool frameInFlight = geometryState.load(std::memory_order_acquire) != GEOMETRY_IDLE;
+        if (frameInFlight) {
+            WaitForGeometryState([](int s) { return s == GEOMETRY_DONE; });
+            geometryState.store(GEOMETRY_IDLE, std::memory_order_relaxed);
+            std::swap(geometryFrame, rasterFrame);
+        }
+
+        UpdateAssets();
+        HandleInput(elapsedTime);
+
+        if (pipelined) {
+            if (!geometryThread.joinable())
+                geometryThread = std::thread(&GrahpicsEngine::GeometryWorker, this);
+
+            //nothing was queued before the first pipelined frame, so that one is built here to fill the pipeline
+            if (!frameInFlight) {
+                geometryFrame = rasterFrame = &framePackets[0];
+                BuildFrame(pendingSimulationSteps, blend);
+                pendingSimulationSteps.clear();
+                geometryFrame = &framePackets[1];
+            }
+
+            geometrySimulationSteps.swap(pendingSimulationSteps);
+            pendingSimulationSteps.clear();
+            geometryBlend = blend;
+            SetGeometryState(GEOMETRY_REQUESTED);
+        }
+        else {
+            StopGeometryThread();
+            geometryFrame = rasterFrame = &framePackets[0];
+            BuildFrame(pendingSimulationSteps, blend);
+            pendingSimulationSteps.clear();
+        }
+
+        RasterizeFrame();
+        return true;
+    }
+
 };
 
 int main()
@@ -390,8 +390,11 @@ int main()
 #include <list>
 #include <thread>
 #include <atomic>
+#include <mutex>
+#include <condition_variable>
 #include <fstream>
 #include <map>
+#include <unordered_map>
 #include <functional>
 #include <algorithm>
 #include <array>
@@ -440,6 +443,12 @@ int main()
 
 #define UNUSED(x) (void)(x)
 
+// SSE2 is baseline on x64, define OLC_DISABLE_SIMD to force the portable paths
+#if !defined(OLC_DISABLE_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+	#define OLC_SIMD_SSE2
+	#include <emmintrin.h>
+#endif
+
 // O------------------------------------------------------------------------------O
 // | PLATFORM SELECTION CODE, Thanks slavka!                                      |
 // O------------------------------------------------------------------------------O
@@ -549,6 +558,18 @@ int main()
 #endif
 #endif
 
+// Resource packs are memory mapped where the platform allows, and read whole otherwise
+#if defined(__linux__) || defined(__FreeBSD__) || defined(__APPLE__)
+	#define OLC_RESOURCEPACK_MMAP
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <fcntl.h>
+	#include <unistd.h>
+#endif
+#if defined(OLC_PLATFORM_WINAPI) && !defined(OLC_PGE_HEADLESS)
+	#define OLC_RESOURCEPACK_WINMAP
+#endif
+
 #if defined(OLC_PGE_HEADLESS)
 #if defined max
 #undef max
@@ -574,6 +595,7 @@ namespace olc
 	constexpr uint32_t nDefaultPixel = (nDefaultAlpha << 24);
 	constexpr uint8_t  nTabSizeInSpaces = 4;
 	constexpr size_t OLC_MAX_VERTS = 128;
+	constexpr size_t nStreamFillBytes = 4 * 1024 * 1024;
 	enum rcode { FAIL = 0, OK = 1, NO_FILE = -1 };
 
 	// O------------------------------------------------------------------------------O
@@ -610,6 +632,9 @@ namespace olc
 
 	Pixel PixelF(float red, float green, float blue, float alpha = 1.0f);
 	Pixel PixelLerp(const olc::Pixel& p1, const olc::Pixel& p2, float t);
+	// Writes p to nCount consecutive pixels, bStream bypasses the cache for buffers
+	// that will not be read again soon
+	void PixelFill(olc::Pixel* pDst, size_t nCount, olc::Pixel p, bool bStream = false);
 
 
 	// O------------------------------------------------------------------------------O
@@ -750,8 +775,25 @@ namespace olc
 	// O------------------------------------------------------------------------------O
 	struct ResourceBuffer : public std::streambuf
 	{
+		ResourceBuffer() = default;
+		// Reads a copy of size bytes at offset into vMemory
 		ResourceBuffer(std::ifstream& ifs, uint32_t offset, uint32_t size);
+		// A read-only view of memory owned elsewhere, nothing is copied
+		ResourceBuffer(const char* data, size_t size);
+		ResourceBuffer(const ResourceBuffer& rb);
+		ResourceBuffer& operator=(const ResourceBuffer& rb);
+		// The bytes of the resource, wherever they live
+		const char* Data() const;
+		size_t Size() const;
+		// False if the resource wasn't found
+		bool Valid() const;
 		std::vector<char> vMemory;
+	protected:
+		pos_type seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which) override;
+		pos_type seekpos(pos_type pos, std::ios_base::openmode which) override;
+	private:
+		const char* pData = nullptr;
+		size_t nSize = 0;
 	};
 
 	class ResourcePack : public std::streambuf
@@ -759,17 +801,56 @@ namespace olc
 	public:
 		ResourcePack();
 		~ResourcePack();
+		ResourcePack(const ResourcePack&) = delete;
+		ResourcePack& operator=(const ResourcePack&) = delete;
 		bool AddFile(const std::string& sFile);
 		bool LoadPack(const std::string& sFile, const std::string& sKey);
-		bool SavePack(const std::string& sFile, const std::string& sKey);
+		// With bCompress the files are stored as compressed blocks (a v2 pack), which
+		// are unpacked on demand by a pool of worker threads
+		bool SavePack(const std::string& sFile, const std::string& sKey, bool bCompress = false);
+		// Returns a view straight into the loaded pack, valid while the pack stays loaded.
+		// Compressed files are unpacked on first use and viewed in the unpacked copy, kept
+		// until ReleaseFile(). Files not in the pack give an empty buffer that isn't Valid()
 		ResourceBuffer GetFileBuffer(const std::string& sFile);
+		// Starts unpacking compressed files in the background, so they are ready, or at
+		// least under way, by the time GetFileBuffer() asks for them
+		void Prefetch(const std::vector<std::string>& vFiles);
+		// Frees the unpacked copy of a compressed file, any views of it become invalid
+		void ReleaseFile(const std::string& sFile);
+		bool Contains(const std::string& sFile) const;
 		bool Loaded();
 	private:
-		struct sResourceFile { uint32_t nSize; uint32_t nOffset; };
-		std::map<std::string, sResourceFile> mapFiles;
-		std::ifstream baseFile;
+		struct sResourceFile { uint32_t nSize; uint32_t nOffset; uint32_t nFirstBlock = 0; uint32_t nBlocks = 0; bool bPacked = false; };
+		struct sResourceBlock { uint64_t nOffset; uint32_t nPackedSize; uint32_t nSize; };
+		struct sUnpackedFile { std::vector<char> vData; uint32_t nBlocksLeft = 0; bool bFailed = false; };
+		std::unordered_map<std::string, sResourceFile> mapFiles;
+		std::vector<sResourceBlock> vBlocks;
+		std::unordered_map<std::string, std::unique_ptr<sUnpackedFile>> mapUnpacked;
+		const char* pPackData = nullptr;
+		size_t nPackSize = 0;
+		std::vector<char> vPackData; // Holds the whole pack when it can't be mapped
+		void* hPackFile = nullptr;
+		void* hPackMapping = nullptr;
+
+		// Worker pool unpacking blocks, started the first time something needs unpacking.
+		// muxJobs guards the job list and everything in mapUnpacked
+		std::vector<std::thread> vWorkers;
+		std::list<std::function<void()>> listJobs;
+		std::mutex muxJobs;
+		std::condition_variable cvJobs;
+		std::condition_variable cvUnpacked;
+		bool bStopWorkers = false;
+
+		bool MapPack(const std::string& sFile);
+		void UnmapPack();
+		bool SaveCompressedPack(const std::string& sFile, const std::string& sKey);
+		sUnpackedFile* Unpack(const std::string& sFile, const sResourceFile& e);
+		void WorkerThread();
+		void StopWorkers();
 		std::vector<char> scramble(const std::vector<char>& data, const std::string& key);
 		std::string makeposix(const std::string& path);
+		static std::vector<char> compress(const char* data, size_t size);
+		static bool decompress(const char* src, size_t srcSize, char* dst, size_t dstSize);
 	};
 
 
@@ -779,6 +860,8 @@ namespace olc
 		ImageLoader() = default;
 		virtual ~ImageLoader() = default;
 		virtual olc::rcode LoadImageResource(olc::Sprite* spr, const std::string& sImageFile, olc::ResourcePack* pack) = 0;
+		// Decodes an image file already in memory, loaders that can't report FAIL
+		virtual olc::rcode LoadImageMemory(olc::Sprite* spr, const char* pData, size_t nSize) { UNUSED(spr); UNUSED(pData); UNUSED(nSize); return olc::rcode::FAIL; }
 		virtual olc::rcode SaveImageResource(olc::Sprite* spr, const std::string& sImageFile) = 0;
 	};
 
@@ -797,12 +880,14 @@ namespace olc
 
 	public:
 		olc::rcode LoadFromFile(const std::string& sImageFile, olc::ResourcePack* pack = nullptr);
+		olc::rcode LoadFromMemory(const char* pData, size_t nSize);
 
 	public:
 		int32_t width = 0;
 		int32_t height = 0;
 		enum Mode { NORMAL, PERIODIC, CLAMP };
 		enum Flip { NONE = 0, HORIZ = 1, VERT = 2 };
+		enum Layout { LINEAR, TILED };
 
 	public:
 		void SetSampleMode(olc::Sprite::Mode mode = olc::Sprite::Mode::NORMAL);
@@ -814,12 +899,31 @@ namespace olc
 		Pixel Sample(const olc::vf2d& uv) const;
 		Pixel SampleBL(float u, float v) const;
 		Pixel SampleBL(const olc::vf2d& uv) const;
+		// Bilinear samples a whole span of UVs, four at a time in 8-bit fixed point,
+		// alpha is filtered too and out of range texels follow modeSample
+		void SampleBL(const olc::vf2d* pUV, olc::Pixel* pOut, size_t nCount) const;
+		// Mipmapping - the chain is built once and is not kept in step with SetPixel(),
+		// call GenerateMipmaps() again after editing the sprite
+		void GenerateMipmaps();
+		void ClearMipmaps();
+		int32_t MipLevels() const;
+		const olc::Sprite* GetMipLevel(int32_t level) const;
+		float MipLevelFor(const olc::vf2d& dUVdx, const olc::vf2d& dUVdy) const;
+		Pixel SampleTL(float u, float v, float lod) const;
+		Pixel SampleTL(const olc::vf2d& uv, float lod) const;
+		// Storage layout - TILED keeps 4x4 blocks together so steep sampling stays in
+		// cache, it is meant for textures; draw targets and GetData() users expect LINEAR
+		void SetLayout(olc::Sprite::Layout layout);
+		olc::Sprite::Layout GetLayout() const;
+		size_t PixelIndex(int32_t x, int32_t y) const;
 		Pixel* GetData();
 		olc::Sprite* Duplicate();
 		olc::Sprite* Duplicate(const olc::vi2d& vPos, const olc::vi2d& vSize);
 		olc::vi2d Size() const;
 		std::vector<olc::Pixel> pColData;
 		Mode modeSample = Mode::NORMAL;
+		Layout layoutStorage = Layout::LINEAR;
+		std::vector<std::unique_ptr<olc::Sprite>> vMips;
 
 		static std::unique_ptr<olc::ImageLoader> loader;
 	};
@@ -973,6 +1077,9 @@ namespace olc
 		virtual bool OnUserCreate();
 		// Called every frame, and provides you with a time per frame value
 		virtual bool OnUserUpdate(float fElapsedTime);
+		// Called zero or more times before each OnUserUpdate() at the rate set by
+		// SetFixedTimestep(), always with the same time step
+		virtual bool OnUserFixedUpdate(float fFixedTimestep);
 		// Called once on application termination, so you can be one clean coder
 		virtual bool OnUserDestroy();
 
@@ -1022,6 +1129,23 @@ namespace olc
 		uint32_t GetFPS() const;
 		// Gets last update of elapsed time
 		float GetElapsedTime() const;
+		// Ticks OnUserFixedUpdate() every fStep seconds, 0 turns fixed updates off. At most
+		// nMaxSteps ticks run per frame, time beyond that is dropped so slow frames can't snowball
+		void SetFixedTimestep(float fStep, int32_t nMaxSteps = 8);
+		// Gets the fixed update time step, 0 when fixed updates are off
+		float GetFixedTimestep() const;
+		// Gets how far between the last fixed update and the next one this frame is, 0 to 1,
+		// for blending the last two simulated states when drawing
+		float GetFixedAlpha() const;
+		// Caps the frame rate by waiting until fFrameTime seconds have passed since the last
+		// frame started, 0 turns the limit off. The wait sleeps while there is time to spare
+		// and spins for the last fSpinTime seconds, so it costs little CPU and adds no jitter
+		void SetFrameLimit(float fFrameTime, float fSpinTime = 0.002f);
+		// Gets the frame time limit, 0 when frames aren't limited
+		float GetFrameLimit() const;
+		// Gets the time from input being read to the frame being presented, in seconds,
+		// for the last frame
+		float GetInputLatency() const;
 		// Gets Actual Window size
 		const olc::vi2d& GetWindowSize() const;
 		// Gets pixel scale
@@ -1229,6 +1353,15 @@ namespace olc
 		bool		bEnableVSYNC = false;
 		float		fFrameTimer = 1.0f;
 		float		fLastElapsed = 0.0f;
+		float		fFixedTimestep = 0.0f;
+		float		fFixedAccumulator = 0.0f;
+		float		fFixedAlpha = 0.0f;
+		int32_t		nMaxFixedSteps = 8;
+		float		fFrameLimit = 0.0f;
+		float		fFrameLimitSpin = 0.002f;
+		float		fSleepEstimate = 0.001f;
+		float		fInputLatency = 0.0f;
+		float		fLatencyTotal = 0.0f;
 		int			nFrameCount = 0;		
 		bool bSuspendTextureTransfer = false;
 		Renderable  fontRenderable;
@@ -1239,7 +1372,7 @@ namespace olc
 		DecalMode   nDecalMode = DecalMode::NORMAL;
 		DecalStructure nDecalStructure = DecalStructure::FAN;
 		std::function<olc::Pixel(const int x, const int y, const olc::Pixel&, const olc::Pixel&)> funcPixelMode;
-		std::chrono::time_point<std::chrono::system_clock> m_tp1, m_tp2;
+		std::chrono::time_point<std::chrono::steady_clock> m_tp1, m_tp2, m_tpInput;
 		std::vector<olc::vi2d> vFontSpacing;
 		std::vector<std::string> vDroppedFiles;
 		std::vector<std::string> vDroppedFilesCache;
@@ -1265,6 +1398,10 @@ namespace olc
 		int32_t nTextEntryCursor = 0;
 		std::vector<std::tuple<olc::Key, std::string, std::string>> vKeyboardMap;
 
+		// Sprite Blitting Specific
+		std::vector<int32_t> vBlitColumns;
+		std::vector<olc::Pixel> vBlitSpan;
+		bool BlitSprite(int32_t x, int32_t y, olc::Sprite* sprite, int32_t ox, int32_t oy, int32_t w, int32_t h, uint32_t scale, uint8_t flip);
 
 
 		// State of keyboard		
@@ -1293,6 +1430,7 @@ namespace olc
 		void olc_UpdateViewport();
 		void olc_ConstructFontSheet();
 		void olc_CoreUpdate();
+		void olc_WaitForFrameLimit();
 		void olc_PrepareEngine();
 		void olc_UpdateMouseState(int32_t button, bool state);
 		void olc_UpdateKeyState(int32_t key, bool state);
@@ -1568,6 +1706,27 @@ namespace olc
 	Pixel PixelLerp(const olc::Pixel& p1, const olc::Pixel& p2, float t)
 	{ return (p2 * t) + p1 * (1.0f - t); }
 
+	void PixelFill(olc::Pixel* pDst, size_t nCount, olc::Pixel p, bool bStream)
+	{
+#if defined(OLC_SIMD_SSE2)
+		// Scalar up to a 16 byte boundary, then four pixels per store
+		while (nCount > 0 && (reinterpret_cast<uintptr_t>(pDst) & 15) != 0) { *pDst++ = p; nCount--; }
+		__m128i v = _mm_set1_epi32(int32_t(p.n));
+		size_t nBlocks = nCount / 4;
+		if (bStream)
+		{
+			for (size_t i = 0; i < nBlocks; i++) _mm_stream_si128((__m128i*)pDst + i, v);
+			_mm_sfence();
+		}
+		else
+			for (size_t i = 0; i < nBlocks; i++) _mm_store_si128((__m128i*)pDst + i, v);
+		pDst += nBlocks * 4; nCount -= nBlocks * 4;
+#else
+		UNUSED(bStream);
+#endif
+		std::fill(pDst, pDst + nCount, p);
+	}
+
 	// O------------------------------------------------------------------------------O
 	// | olc::Sprite IMPLEMENTATION                                                   |
 	// O------------------------------------------------------------------------------O
@@ -1588,7 +1747,10 @@ namespace olc
 	{ pColData.clear();	}
 
 	void Sprite::SetSampleMode(olc::Sprite::Mode mode)
-	{ modeSample = mode; }
+	{ 
+		modeSample = mode; 
+		for (auto& mip : vMips) mip->modeSample = mode;
+	}
 
 	Pixel Sprite::GetPixel(const olc::vi2d& a) const
 	{ return GetPixel(a.x, a.y); }
@@ -1601,16 +1763,16 @@ namespace olc
 		if (modeSample == olc::Sprite::Mode::NORMAL)
 		{
 			if (x >= 0 && x < width && y >= 0 && y < height)
-				return pColData[y * width + x];
+				return pColData[PixelIndex(x, y)];
 			else
 				return Pixel(0, 0, 0, 0);
 		}
 		else
 		{
 			if (modeSample == olc::Sprite::Mode::PERIODIC)
-				return pColData[abs(y % height) * width + abs(x % width)];
+				return pColData[PixelIndex(abs(x % width), abs(y % height))];
 			else
-				return pColData[std::max(0, std::min(y, height-1)) * width + std::max(0, std::min(x, width-1))];
+				return pColData[PixelIndex(std::max(0, std::min(x, width-1)), std::max(0, std::min(y, height-1)))];
 		}
 	}
 
@@ -1618,7 +1780,7 @@ namespace olc
 	{
 		if (x >= 0 && x < width && y >= 0 && y < height)
 		{
-			pColData[y * width + x] = p;
+			pColData[PixelIndex(x, y)] = p;
 			return true;
 		}
 		else
@@ -1656,7 +1818,8 @@ namespace olc
 		return olc::Pixel(
 			(uint8_t)((p1.r * u_opposite + p2.r * u_ratio) * v_opposite + (p3.r * u_opposite + p4.r * u_ratio) * v_ratio),
 			(uint8_t)((p1.g * u_opposite + p2.g * u_ratio) * v_opposite + (p3.g * u_opposite + p4.g * u_ratio) * v_ratio),
-			(uint8_t)((p1.b * u_opposite + p2.b * u_ratio) * v_opposite + (p3.b * u_opposite + p4.b * u_ratio) * v_ratio));
+			(uint8_t)((p1.b * u_opposite + p2.b * u_ratio) * v_opposite + (p3.b * u_opposite + p4.b * u_ratio) * v_ratio),
+			(uint8_t)((p1.a * u_opposite + p2.a * u_ratio) * v_opposite + (p3.a * u_opposite + p4.a * u_ratio) * v_ratio));
 	}
 
 	Pixel Sprite::SampleBL(const olc::vf2d& uv) const
@@ -1664,6 +1827,268 @@ namespace olc
 		return SampleBL(uv.x, uv.y);
 	}
 
+	void Sprite::SampleBL(const olc::vf2d* pUV, olc::Pixel* pOut, size_t nCount) const
+	{
+		if (width <= 0 || height <= 0)
+		{
+			std::fill(pOut, pOut + nCount, olc::BLANK);
+			return;
+		}
+
+		// Texel coordinates are 24.8 fixed point, the 128 re-centres the footprint on texel
+		// centres and the limit keeps wild UVs (NaN included) inside int32_t
+		const float fScaleU = float(width) * 256.0f, fScaleV = float(height) * 256.0f, fLimit = 1073741824.0f;
+		const uint32_t* pData = (const uint32_t*)pColData.data();
+		alignas(16) int32_t nX0[4], nX1[4], nY0[4], nY1[4];
+		alignas(16) uint32_t p00[4], p10[4], p01[4], p11[4];
+
+		for (size_t i = 0; i < nCount; i += 4)
+		{
+			// The tail is padded out to a full group of four
+			size_t nGroup = std::min(size_t(4), nCount - i);
+			olc::vf2d vUV[4];
+			std::copy(pUV + i, pUV + i + nGroup, vUV);
+			olc::Pixel vOut[4];
+
+#if defined(OLC_SIMD_SSE2)
+			auto vmin = [](__m128i a, __m128i b) { __m128i m = _mm_cmpgt_epi32(a, b); return _mm_or_si128(_mm_and_si128(m, b), _mm_andnot_si128(m, a)); };
+			auto vmax = [](__m128i a, __m128i b) { __m128i m = _mm_cmpgt_epi32(a, b); return _mm_or_si128(_mm_and_si128(m, a), _mm_andnot_si128(m, b)); };
+			auto vfloor = [](__m128 f) { __m128i t = _mm_cvttps_epi32(f); return _mm_add_epi32(t, _mm_castps_si128(_mm_cmpgt_ps(_mm_cvtepi32_ps(t), f))); };
+
+			// Resolves a texel coordinate and its neighbour per modeSample, the masks
+			// blank texels that NORMAL mode treats as outside the sprite
+			auto address = [&](__m128i c, int32_t nSize, __m128i& a, __m128i& b, __m128i& va, __m128i& vb)
+			{
+				__m128i vSize = _mm_set1_epi32(nSize), vLast = _mm_set1_epi32(nSize - 1), zero = _mm_setzero_si128();
+				__m128i c1 = _mm_add_epi32(c, _mm_set1_epi32(1));
+				va = vb = _mm_set1_epi32(-1);
+				if (modeSample == olc::Sprite::Mode::PERIODIC)
+				{
+					auto wrap = [&](__m128i x)
+					{
+						__m128 f = _mm_cvtepi32_ps(x), fSize = _mm_cvtepi32_ps(vSize);
+						__m128i q = vfloor(_mm_mul_ps(f, _mm_set1_ps(1.0f / float(nSize))));
+						__m128i r = _mm_cvttps_epi32(_mm_sub_ps(f, _mm_mul_ps(_mm_cvtepi32_ps(q), fSize)));
+						// The reciprocal can land a quotient one off, fold the remainder back in
+						r = _mm_add_epi32(r, _mm_and_si128(_mm_cmplt_epi32(r, zero), vSize));
+						return _mm_sub_epi32(r, _mm_and_si128(_mm_cmpgt_epi32(r, vLast), vSize));
+					};
+					a = wrap(c); b = wrap(c1);
+				}
+				else
+				{
+					a = vmin(vmax(c, zero), vLast); b = vmin(vmax(c1, zero), vLast);
+					if (modeSample == olc::Sprite::Mode::NORMAL)
+					{
+						va = _mm_cmplt_epi32(c, vSize);
+						vb = _mm_cmpgt_epi32(c1, _mm_set1_epi32(-1));
+					}
+				}
+			};
+
+			__m128 l = _mm_loadu_ps(&vUV[0].x), h = _mm_loadu_ps(&vUV[2].x);
+			__m128 u = _mm_sub_ps(_mm_mul_ps(_mm_shuffle_ps(l, h, _MM_SHUFFLE(2, 0, 2, 0)), _mm_set1_ps(fScaleU)), _mm_set1_ps(128.0f));
+			__m128 v = _mm_sub_ps(_mm_mul_ps(_mm_shuffle_ps(l, h, _MM_SHUFFLE(3, 1, 3, 1)), _mm_set1_ps(fScaleV)), _mm_set1_ps(128.0f));
+			__m128i fu = vfloor(_mm_min_ps(_mm_max_ps(u, _mm_set1_ps(-fLimit)), _mm_set1_ps(fLimit)));
+			__m128i fv = vfloor(_mm_min_ps(_mm_max_ps(v, _mm_set1_ps(-fLimit)), _mm_set1_ps(fLimit)));
+
+			__m128i x0, x1, y0, y1, vx0, vx1, vy0, vy1;
+			address(_mm_srai_epi32(fu, 8), width, x0, x1, vx0, vx1);
+			address(_mm_srai_epi32(fv, 8), height, y0, y1, vy0, vy1);
+			_mm_store_si128((__m128i*)nX0, x0); _mm_store_si128((__m128i*)nX1, x1);
+			_mm_store_si128((__m128i*)nY0, y0); _mm_store_si128((__m128i*)nY1, y1);
+
+			// SSE2 has no gather, the sixteen fetches are scalar
+			for (int k = 0; k < 4; k++)
+			{
+				p00[k] = pData[PixelIndex(nX0[k], nY0[k])]; p10[k] = pData[PixelIndex(nX1[k], nY0[k])];
+				p01[k] = pData[PixelIndex(nX0[k], nY1[k])]; p11[k] = pData[PixelIndex(nX1[k], nY1[k])];
+			}
+
+			__m128i t00 = _mm_and_si128(_mm_load_si128((const __m128i*)p00), _mm_and_si128(vx0, vy0));
+			__m128i t10 = _mm_and_si128(_mm_load_si128((const __m128i*)p10), _mm_and_si128(vx1, vy0));
+			__m128i t01 = _mm_and_si128(_mm_load_si128((const __m128i*)p01), _mm_and_si128(vx0, vy1));
+			__m128i t11 = _mm_and_si128(_mm_load_si128((const __m128i*)p11), _mm_and_si128(vx1, vy1));
+
+			// Each 8-bit weight is spread over the four 16-bit channel lanes of its sample,
+			// a * (256 - w) + b * w + 128 never exceeds 16 bits
+			auto spread = [](__m128i w, __m128i& lo, __m128i& hi)
+			{
+				__m128i p = _mm_packs_epi32(w, w);
+				p = _mm_unpacklo_epi16(p, p);
+				lo = _mm_unpacklo_epi32(p, p); hi = _mm_unpackhi_epi32(p, p);
+			};
+			auto lerp = [](__m128i a, __m128i b, __m128i w)
+			{
+				__m128i w0 = _mm_sub_epi16(_mm_set1_epi16(256), w);
+				__m128i sum = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(a, w0), _mm_mullo_epi16(b, w)), _mm_set1_epi16(128));
+				return _mm_srli_epi16(sum, 8);
+			};
+
+			__m128i mask = _mm_set1_epi32(255), zero = _mm_setzero_si128(), wxl, wxh, wyl, wyh;
+			spread(_mm_and_si128(fu, mask), wxl, wxh);
+			spread(_mm_and_si128(fv, mask), wyl, wyh);
+			__m128i lo = lerp(lerp(_mm_unpacklo_epi8(t00, zero), _mm_unpacklo_epi8(t10, zero), wxl), lerp(_mm_unpacklo_epi8(t01, zero), _mm_unpacklo_epi8(t11, zero), wxl), wyl);
+			__m128i hi = lerp(lerp(_mm_unpackhi_epi8(t00, zero), _mm_unpackhi_epi8(t10, zero), wxh), lerp(_mm_unpackhi_epi8(t01, zero), _mm_unpackhi_epi8(t11, zero), wxh), wyh);
+			_mm_storeu_si128((__m128i*)vOut, _mm_packus_epi16(lo, hi));
+#else
+			// Same fixed point arithmetic as the SSE2 path, one sample at a time
+			auto address = [&](int32_t c, int32_t nSize, int32_t& a, int32_t& b, uint32_t& va, uint32_t& vb)
+			{
+				va = vb = 0xFFFFFFFF;
+				if (modeSample == olc::Sprite::Mode::PERIODIC)
+				{
+					a = ((c % nSize) + nSize) % nSize; b = (((c + 1) % nSize) + nSize) % nSize;
+				}
+				else
+				{
+					a = std::max(0, std::min(c, nSize - 1)); b = std::max(0, std::min(c + 1, nSize - 1));
+					if (modeSample == olc::Sprite::Mode::NORMAL)
+					{
+						va = (c < nSize) ? 0xFFFFFFFF : 0; vb = (c + 1 >= 0) ? 0xFFFFFFFF : 0;
+					}
+				}
+			};
+			auto lerp = [](uint32_t a, uint32_t b, uint32_t w)
+			{
+				uint32_t r = 0;
+				for (int s = 0; s < 32; s += 8)
+					r |= ((((a >> s) & 0xFF) * (256 - w) + ((b >> s) & 0xFF) * w + 128) >> 8) << s;
+				return r;
+			};
+
+			for (int k = 0; k < 4; k++)
+			{
+				int32_t fu = int32_t(std::floor(std::min(std::max(-fLimit, vUV[k].x * fScaleU - 128.0f), fLimit)));
+				int32_t fv = int32_t(std::floor(std::min(std::max(-fLimit, vUV[k].y * fScaleV - 128.0f), fLimit)));
+				uint32_t vx0, vx1, vy0, vy1;
+				address(fu >> 8, width, nX0[k], nX1[k], vx0, vx1);
+				address(fv >> 8, height, nY0[k], nY1[k], vy0, vy1);
+				p00[k] = pData[PixelIndex(nX0[k], nY0[k])] & vx0 & vy0; p10[k] = pData[PixelIndex(nX1[k], nY0[k])] & vx1 & vy0;
+				p01[k] = pData[PixelIndex(nX0[k], nY1[k])] & vx0 & vy1; p11[k] = pData[PixelIndex(nX1[k], nY1[k])] & vx1 & vy1;
+				vOut[k].n = lerp(lerp(p00[k], p10[k], fu & 0xFF), lerp(p01[k], p11[k], fu & 0xFF), fv & 0xFF);
+			}
+#endif
+			std::copy(vOut, vOut + nGroup, pOut + i);
+		}
+	}
+
+	void Sprite::GenerateMipmaps()
+	{
+		vMips.clear();
+		olc::Sprite::Layout layout = layoutStorage;
+		SetLayout(olc::Sprite::Layout::LINEAR);
+		const olc::Sprite* src = this;
+		while (src->width > 1 || src->height > 1)
+		{
+			olc::Sprite* mip = new olc::Sprite(std::max(1, src->width / 2), std::max(1, src->height / 2));
+			mip->modeSample = modeSample;
+			// An odd sized level folds its last row/column into the final texel, which then
+			// averages 3 source texels on that axis rather than dropping the last one
+			auto taps = [](int i, int nDst, int nSrc) { return (i == nDst - 1 && (nSrc & 1) && nSrc > 1) ? 3 : 2; };
+			for (int y = 0; y < mip->height; y++)
+			{
+				int ny = taps(y, mip->height, src->height);
+				const uint32_t* r[3];
+				for (int j = 0; j < 3; j++)
+					r[j] = (const uint32_t*)src->pColData.data() + std::min(y * 2 + j, src->height - 1) * src->width;
+				uint32_t* dst = (uint32_t*)mip->pColData.data() + y * mip->width;
+				for (int x = 0; x < mip->width; x++)
+				{
+					int nx = taps(x, mip->width, src->width);
+					// Box filter on all four channels at once, red/blue and green/alpha are summed
+					// in separate 16-bit lanes so they cannot carry into each other (9 taps at most)
+					uint32_t rb = 0, ga = 0;
+					for (int j = 0; j < ny; j++)
+						for (int i = 0; i < nx; i++)
+						{
+							uint32_t p = r[j][std::min(x * 2 + i, src->width - 1)];
+							rb += p & 0x00FF00FF;
+							ga += (p >> 8) & 0x00FF00FF;
+						}
+					uint32_t n = uint32_t(nx * ny);
+					if (n == 4)
+						dst[x] = (((rb + 0x00020002) >> 2) & 0x00FF00FF) | ((((ga + 0x00020002) >> 2) & 0x00FF00FF) << 8);
+					else
+					{
+						auto average = [n](uint32_t sum) { return (((sum & 0xFFFF) + n / 2) / n) | ((((sum >> 16) + n / 2) / n) << 16); };
+						dst[x] = average(rb) | (average(ga) << 8);
+					}
+				}
+			}
+			vMips.emplace_back(mip);
+			src = mip;
+		}
+		SetLayout(layout);
+	}
+
+	void Sprite::ClearMipmaps()
+	{ vMips.clear(); }
+
+	int32_t Sprite::MipLevels() const
+	{ return int32_t(vMips.size()) + 1; }
+
+	const olc::Sprite* Sprite::GetMipLevel(int32_t level) const
+	{
+		level = std::max(0, std::min(level, int32_t(vMips.size())));
+		return level == 0 ? this : vMips[level - 1].get();
+	}
+
+	float Sprite::MipLevelFor(const olc::vf2d& dUVdx, const olc::vf2d& dUVdy) const
+	{
+		// Texel footprint of one screen pixel, taken along the longer axis
+		olc::vf2d vSize = olc::vf2d(Size());
+		float fFootprint = std::max((dUVdx * vSize).mag2(), (dUVdy * vSize).mag2());
+		if (fFootprint <= 1.0f) return 0.0f;
+		return std::min(0.5f * std::log2(fFootprint), float(vMips.size()));
+	}
+
+	Pixel Sprite::SampleTL(float u, float v, float lod) const
+	{
+		lod = std::max(0.0f, std::min(lod, float(vMips.size())));
+		int32_t nLevel = int32_t(lod);
+		float fBlend = lod - float(nLevel);
+		olc::Pixel p1 = GetMipLevel(nLevel)->SampleBL(u, v);
+		if (fBlend == 0.0f) return p1;
+		return PixelLerp(p1, GetMipLevel(nLevel + 1)->SampleBL(u, v), fBlend);
+	}
+
+	Pixel Sprite::SampleTL(const olc::vf2d& uv, float lod) const
+	{
+		return SampleTL(uv.x, uv.y, lod);
+	}
+
+	void Sprite::SetLayout(olc::Sprite::Layout layout)
+	{
+		for (auto& mip : vMips) mip->SetLayout(layout);
+		if (layout == layoutStorage) return;
+
+		// Tiled storage is padded out to whole tiles
+		size_t nSize = (layout == olc::Sprite::Layout::TILED) ? size_t((width + 3) & ~3) * size_t((height + 3) & ~3) : size_t(width) * size_t(height);
+		std::vector<olc::Pixel> vData(nSize);
+		layoutStorage = olc::Sprite::Layout::TILED;
+		for (int y = 0; y < height; y++)
+			for (int x = 0; x < width; x++)
+			{
+				size_t nTiled = PixelIndex(x, y), nLinear = size_t(y) * size_t(width) + size_t(x);
+				if (layout == olc::Sprite::Layout::TILED) vData[nTiled] = pColData[nLinear];
+				else vData[nLinear] = pColData[nTiled];
+			}
+		layoutStorage = layout;
+		pColData.swap(vData);
+	}
+
+	olc::Sprite::Layout Sprite::GetLayout() const
+	{ return layoutStorage; }
+
+	size_t Sprite::PixelIndex(int32_t x, int32_t y) const
+	{
+		if (layoutStorage == olc::Sprite::Layout::LINEAR)
+			return size_t(y) * size_t(width) + size_t(x);
+		// A 4x4 tile of 32-bit pixels fills exactly one 64-byte cache line
+		return (size_t(y >> 2) * size_t((width + 3) >> 2) + size_t(x >> 2)) * 16 + size_t((y & 3) << 2) + size_t(x & 3);
+	}
+
 	Pixel* Sprite::GetData()
 	{ return pColData.data(); }
 
@@ -1671,14 +2096,26 @@ namespace olc
 	olc::rcode Sprite::LoadFromFile(const std::string& sImageFile, olc::ResourcePack* pack)
 	{
 		UNUSED(pack);
+		// Loaders always write row-major pixels
+		vMips.clear();
+		layoutStorage = olc::Sprite::Layout::LINEAR;
 		return loader->LoadImageResource(this, sImageFile, pack);
 	}
 
+	olc::rcode Sprite::LoadFromMemory(const char* pData, size_t nSize)
+	{
+		// Loaders always write row-major pixels
+		vMips.clear();
+		layoutStorage = olc::Sprite::Layout::LINEAR;
+		return loader->LoadImageMemory(this, pData, nSize);
+	}
+
 	olc::Sprite* Sprite::Duplicate()
 	{
 		olc::Sprite* spr = new olc::Sprite(width, height);
-		std::memcpy(spr->GetData(), GetData(), width * height * sizeof(olc::Pixel));
+		spr->pColData = pColData;
 		spr->modeSample = modeSample;
+		spr->layoutStorage = layoutStorage;
 		return spr;
 	}
 
@@ -1719,14 +2156,25 @@ namespace olc
 		if (sprite == nullptr) return;
 		vUVScale = { 1.0f / float(sprite->width), 1.0f / float(sprite->height) };
 		renderer->ApplyTexture(id);
-		renderer->UpdateTexture(id, sprite);
+		if (sprite->GetLayout() == olc::Sprite::Layout::TILED)
+		{
+			// Textures are uploaded row-major, so tiled sprites go up via a linear copy
+			std::unique_ptr<olc::Sprite> linear(sprite->Duplicate());
+			linear->SetLayout(olc::Sprite::Layout::LINEAR);
+			renderer->UpdateTexture(id, linear.get());
+		}
+		else
+			renderer->UpdateTexture(id, sprite);
 	}
 
 	void Decal::UpdateSprite()
 	{
 		if (sprite == nullptr) return;
 		renderer->ApplyTexture(id);
+		olc::Sprite::Layout layout = sprite->GetLayout();
+		sprite->SetLayout(olc::Sprite::Layout::LINEAR);
 		renderer->ReadTexture(id, sprite);
+		sprite->SetLayout(layout);
 	}
 
 	Decal::~Decal()
@@ -1778,11 +2226,55 @@ namespace olc
 	{
 		vMemory.resize(size);
 		ifs.seekg(offset); ifs.read(vMemory.data(), vMemory.size());
-		setg(vMemory.data(), vMemory.data(), vMemory.data() + size);
+		pData = vMemory.data(); nSize = size;
+		setg((char*)pData, (char*)pData, (char*)pData + nSize);
+	}
+
+	ResourceBuffer::ResourceBuffer(const char* data, size_t size) : pData(data), nSize(size)
+	{ setg((char*)pData, (char*)pData, (char*)pData + nSize); }
+
+	ResourceBuffer::ResourceBuffer(const ResourceBuffer& rb) : std::streambuf(), vMemory(rb.vMemory), nSize(rb.nSize)
+	{
+		// A copy that owns its memory must point at its own
+		pData = rb.vMemory.empty() ? rb.pData : vMemory.data();
+		setg((char*)pData, (char*)pData + (rb.gptr() - rb.eback()), (char*)pData + nSize);
+	}
+
+	ResourceBuffer& ResourceBuffer::operator=(const ResourceBuffer& rb)
+	{
+		if (this == &rb) return *this;
+		std::ptrdiff_t nPos = rb.gptr() - rb.eback();
+		vMemory = rb.vMemory;
+		nSize = rb.nSize;
+		pData = rb.vMemory.empty() ? rb.pData : vMemory.data();
+		setg((char*)pData, (char*)pData + nPos, (char*)pData + nSize);
+		return *this;
 	}
 
+	const char* ResourceBuffer::Data() const
+	{ return pData; }
+
+	size_t ResourceBuffer::Size() const
+	{ return nSize; }
+
+	bool ResourceBuffer::Valid() const
+	{ return pData != nullptr; }
+
+	ResourceBuffer::pos_type ResourceBuffer::seekoff(off_type off, std::ios_base::seekdir dir, std::ios_base::openmode which)
+	{
+		off_type pos = off;
+		if (dir == std::ios_base::cur) pos += gptr() - eback();
+		if (dir == std::ios_base::end) pos += off_type(nSize);
+		if (!(which & std::ios_base::in) || pos < 0 || pos > off_type(nSize)) return pos_type(off_type(-1));
+		setg(eback(), eback() + pos, egptr());
+		return pos_type(pos);
+	}
+
+	ResourceBuffer::pos_type ResourceBuffer::seekpos(pos_type pos, std::ios_base::openmode which)
+	{ return seekoff(off_type(pos), std::ios_base::beg, which); }
+
 	ResourcePack::ResourcePack() { }
-	ResourcePack::~ResourcePack() { baseFile.close(); }
+	ResourcePack::~ResourcePack() { UnmapPack(); }
 
 	bool ResourcePack::AddFile(const std::string& sFile)
 	{
@@ -1799,54 +2291,186 @@ namespace olc
 		return false;
 	}
 
+	bool ResourcePack::MapPack(const std::string& sFile)
+	{
+		UnmapPack();
+#if defined(OLC_RESOURCEPACK_MMAP)
+		int fd = open(sFile.c_str(), O_RDONLY);
+		if (fd >= 0)
+		{
+			struct stat st;
+			if (fstat(fd, &st) == 0 && st.st_size > 0)
+			{
+				void* p = mmap(nullptr, size_t(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+				if (p != MAP_FAILED)
+				{
+					pPackData = (const char*)p;
+					nPackSize = size_t(st.st_size);
+				}
+			}
+			// The mapping holds its own reference to the file
+			close(fd);
+			if (pPackData) return true;
+		}
+#elif defined(OLC_RESOURCEPACK_WINMAP)
+		HANDLE hFile = CreateFileA(sFile.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+		if (hFile != INVALID_HANDLE_VALUE)
+		{
+			LARGE_INTEGER size;
+			HANDLE hMapping = nullptr;
+			if (GetFileSizeEx(hFile, &size) && size.QuadPart > 0)
+				hMapping = CreateFileMappingA(hFile, nullptr, PAGE_READONLY, 0, 0, nullptr);
+			const void* p = hMapping ? MapViewOfFile(hMapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+			if (p)
+			{
+				hPackFile = hFile; hPackMapping = hMapping;
+				pPackData = (const char*)p;
+				nPackSize = size_t(size.QuadPart);
+				return true;
+			}
+			if (hMapping) CloseHandle(hMapping);
+			CloseHandle(hFile);
+		}
+#endif
+		// No mapping to be had, so the pack is read in whole once instead
+		std::ifstream ifs(sFile, std::ifstream::binary | std::ifstream::ate);
+		if (!ifs.is_open()) return false;
+		vPackData.resize(size_t(ifs.tellg()));
+		ifs.seekg(0);
+		ifs.read(vPackData.data(), vPackData.size());
+		if (!ifs) { vPackData.clear(); return false; }
+		pPackData = vPackData.data();
+		nPackSize = vPackData.size();
+		return true;
+	}
+
+	void ResourcePack::UnmapPack()
+	{
+		// Blocks still being unpacked read from the mapping, so they finish first
+		StopWorkers();
+		mapUnpacked.clear();
+		vBlocks.clear();
+
+#if defined(OLC_RESOURCEPACK_MMAP)
+		if (pPackData && vPackData.empty()) munmap((void*)pPackData, nPackSize);
+#elif defined(OLC_RESOURCEPACK_WINMAP)
+		if (pPackData && vPackData.empty()) UnmapViewOfFile(pPackData);
+		if (hPackMapping) CloseHandle((HANDLE)hPackMapping);
+		if (hPackFile) CloseHandle((HANDLE)hPackFile);
+#endif
+		hPackFile = nullptr; hPackMapping = nullptr;
+		pPackData = nullptr; nPackSize = 0;
+		vPackData.clear(); vPackData.shrink_to_fit();
+	}
+
 	bool ResourcePack::LoadPack(const std::string& sFile, const std::string& sKey)
 	{
-		// Open the resource file
-		baseFile.open(sFile, std::ifstream::binary);
-		if (!baseFile.is_open()) return false;
+		// Map the resource file, it stays mapped so files can be handed out as views into it
+		if (!MapPack(sFile)) return false;
+		mapFiles.clear();
+
+		// v2 packs open with a marker, v1 packs go straight into the index size
+		size_t nStart = 0;
+		bool bV2 = nPackSize >= 4 && memcmp(pPackData, "OLC2", 4) == 0;
+		if (bV2) nStart = 4;
 
 		// 1) Read Scrambled index
 		uint32_t nIndexSize = 0;
-		baseFile.read((char*)&nIndexSize, sizeof(uint32_t));
+		if (nPackSize < nStart + sizeof(uint32_t)) { UnmapPack(); return false; }
+		memcpy(&nIndexSize, pPackData + nStart, sizeof(uint32_t));
+		nStart += sizeof(uint32_t);
+		if (nIndexSize > nPackSize - nStart) { UnmapPack(); return false; }
 
-		std::vector<char> buffer(nIndexSize);
-		for (uint32_t j = 0; j < nIndexSize; j++)
-			buffer[j] = baseFile.get();
-
-		std::vector<char> decoded = scramble(buffer, sKey);
+		std::vector<char> decoded = scramble(std::vector<char>(pPackData + nStart, pPackData + nStart + nIndexSize), sKey);
 		size_t pos = 0;
-		auto read = [&decoded, &pos](char* dst, size_t size) {
+		bool bOverrun = false;
+		auto read = [&decoded, &pos, &bOverrun](char* dst, size_t size) {
+			if (pos + size > decoded.size()) { bOverrun = true; memset(dst, 0, size); return; }
 			memcpy((void*)dst, (const void*)(decoded.data() + pos), size);
 			pos += size;
 		};
 
-		auto get = [&read]() -> int { char c; read(&c, 1); return c; };
-
 		// 2) Read Map
 		uint32_t nMapEntries = 0;
 		read((char*)&nMapEntries, sizeof(uint32_t));
-		for (uint32_t i = 0; i < nMapEntries; i++)
+		for (uint32_t i = 0; i < nMapEntries && !bOverrun; i++)
 		{
 			uint32_t nFilePathSize = 0;
 			read((char*)&nFilePathSize, sizeof(uint32_t));
+			if (nFilePathSize > decoded.size() - pos) { bOverrun = true; break; }
 
-			std::string sFileName(nFilePathSize, ' ');
-			for (uint32_t j = 0; j < nFilePathSize; j++)
-				sFileName[j] = get();
+			std::string sFileName(decoded.data() + pos, nFilePathSize);
+			pos += nFilePathSize;
 
 			sResourceFile e;
 			read((char*)&e.nSize, sizeof(uint32_t));
-			read((char*)&e.nOffset, sizeof(uint32_t));
-			mapFiles[sFileName] = e;
+			if (bV2)
+			{
+				e.nOffset = 0;
+				read((char*)&e.nFirstBlock, sizeof(uint32_t));
+				read((char*)&e.nBlocks, sizeof(uint32_t));
+			}
+			else
+			{
+				read((char*)&e.nOffset, sizeof(uint32_t));
+				if (size_t(e.nOffset) + e.nSize > nPackSize) bOverrun = true;
+			}
+			if (!bOverrun) mapFiles[sFileName] = e;
+		}
+
+		// 3) Read Block Table, v2 only
+		if (bV2 && !bOverrun)
+		{
+			uint32_t nBlockCount = 0;
+			read((char*)&nBlockCount, sizeof(uint32_t));
+			if (nBlockCount > (decoded.size() - pos) / 16) bOverrun = true;
+			else vBlocks.resize(nBlockCount);
+			for (auto& b : vBlocks)
+			{
+				read((char*)&b.nOffset, sizeof(uint64_t));
+				read((char*)&b.nPackedSize, sizeof(uint32_t));
+				read((char*)&b.nSize, sizeof(uint32_t));
+				if (b.nOffset > nPackSize || b.nPackedSize > nPackSize - b.nOffset) bOverrun = true;
+			}
+
+			// Each file's blocks must be in the table and add up to the file
+			for (auto& f : mapFiles)
+			{
+				sResourceFile& e = f.second;
+				if (size_t(e.nFirstBlock) + e.nBlocks > vBlocks.size()) { bOverrun = true; break; }
+				uint64_t nTotal = 0;
+				for (uint32_t j = 0; j < e.nBlocks; j++)
+				{
+					const sResourceBlock& b = vBlocks[e.nFirstBlock + j];
+					nTotal += b.nSize;
+					e.bPacked |= b.nPackedSize != b.nSize;
+				}
+				if (nTotal != e.nSize) { bOverrun = true; break; }
+
+				// Unpacked files are viewed in place as one run, so their blocks must lie back to back
+				if (!e.bPacked && e.nBlocks > 0)
+				{
+					uint64_t nNext = vBlocks[e.nFirstBlock].nOffset;
+					for (uint32_t j = 0; j < e.nBlocks && !bOverrun; j++)
+					{
+						const sResourceBlock& b = vBlocks[e.nFirstBlock + j];
+						if (b.nOffset != nNext) bOverrun = true;
+						nNext += b.nSize;
+					}
+					if (bOverrun) break;
+				}
+			}
 		}
 
-		// Don't close base file! we will provide a stream
-		// pointer when the file is requested
+		// A damaged index leaves nothing loaded rather than views past the end of the pack
+		if (bOverrun) { mapFiles.clear(); UnmapPack(); return false; }
 		return true;
 	}
 
-	bool ResourcePack::SavePack(const std::string& sFile, const std::string& sKey)
+	bool ResourcePack::SavePack(const std::string& sFile, const std::string& sKey, bool bCompress)
 	{
+		if (bCompress) return SaveCompressedPack(sFile, sKey);
+
 		// Create/Overwrite the resource file
 		std::ofstream ofs(sFile, std::ofstream::binary);
 		if (!ofs.is_open()) return false;
@@ -1919,18 +2543,233 @@ namespace olc
 		return true;
 	}
 
+	bool ResourcePack::SaveCompressedPack(const std::string& sFile, const std::string& sKey)
+	{
+		// v2 layout: "OLC2", index size, scrambled index and block table, then the blocks.
+		// Files are cut into blocks that are compressed on their own, so one file can be
+		// unpacked by several workers at once. A block that doesn't shrink is stored as is
+		const uint32_t nBlockSize = 65536;
+
+		std::ofstream ofs(sFile, std::ofstream::binary);
+		if (!ofs.is_open()) return false;
+
+		// 1) Lay out the block table, only the offsets and packed sizes are unknown for now
+		std::vector<sResourceBlock> vPackBlocks;
+		for (auto& e : mapFiles)
+		{
+			e.second.nFirstBlock = uint32_t(vPackBlocks.size());
+			e.second.nBlocks = (e.second.nSize + nBlockSize - 1) / nBlockSize;
+			for (uint32_t i = 0; i < e.second.nBlocks; i++)
+				vPackBlocks.push_back({ 0, 0, std::min(nBlockSize, e.second.nSize - i * nBlockSize) });
+		}
+
+		// The index is the same size whatever the offsets, so it is written once to make
+		// room and again once the blocks are in place
+		auto makeIndex = [&]()
+		{
+			std::vector<char> stream;
+			auto write = [&stream](const void* data, size_t size) {
+				size_t sizeNow = stream.size();
+				stream.resize(sizeNow + size);
+				memcpy(stream.data() + sizeNow, data, size);
+			};
+
+			uint32_t nMapSize = uint32_t(mapFiles.size());
+			write(&nMapSize, sizeof(uint32_t));
+			for (auto& e : mapFiles)
+			{
+				uint32_t nPathSize = uint32_t(e.first.size());
+				write(&nPathSize, sizeof(uint32_t));
+				write(e.first.c_str(), nPathSize);
+				write(&e.second.nSize, sizeof(uint32_t));
+				write(&e.second.nFirstBlock, sizeof(uint32_t));
+				write(&e.second.nBlocks, sizeof(uint32_t));
+			}
+
+			uint32_t nBlockCount = uint32_t(vPackBlocks.size());
+			write(&nBlockCount, sizeof(uint32_t));
+			for (auto& b : vPackBlocks)
+			{
+				write(&b.nOffset, sizeof(uint64_t));
+				write(&b.nPackedSize, sizeof(uint32_t));
+				write(&b.nSize, sizeof(uint32_t));
+			}
+			return scramble(stream, sKey);
+		};
+
+		std::vector<char> vIndex = makeIndex();
+		uint32_t nIndexSize = uint32_t(vIndex.size());
+		ofs.write("OLC2", 4);
+		ofs.write((char*)&nIndexSize, sizeof(uint32_t));
+		ofs.write(vIndex.data(), nIndexSize);
+
+		// 2) Compress and write the blocks, file by file
+		uint64_t nOffset = 4 + sizeof(uint32_t) + nIndexSize;
+		for (auto& e : mapFiles)
+		{
+			std::vector<char> vBuffer(e.second.nSize);
+			std::ifstream i(e.first, std::ifstream::binary);
+			i.read(vBuffer.data(), e.second.nSize);
+			i.close();
+
+			for (uint32_t n = 0; n < e.second.nBlocks; n++)
+			{
+				sResourceBlock& b = vPackBlocks[e.second.nFirstBlock + n];
+				const char* pRaw = vBuffer.data() + size_t(n) * nBlockSize;
+				std::vector<char> vPacked = compress(pRaw, b.nSize);
+				if (vPacked.size() < b.nSize)
+				{
+					b.nPackedSize = uint32_t(vPacked.size());
+					ofs.write(vPacked.data(), vPacked.size());
+				}
+				else
+				{
+					b.nPackedSize = b.nSize;
+					ofs.write(pRaw, b.nSize);
+				}
+				b.nOffset = nOffset;
+				nOffset += b.nPackedSize;
+			}
+		}
+
+		// 3) Rewrite the index now the block table is complete
+		vIndex = makeIndex();
+		ofs.seekp(4 + sizeof(uint32_t), std::ios::beg);
+		ofs.write(vIndex.data(), nIndexSize);
+		ofs.close();
+		return true;
+	}
+
 	ResourceBuffer ResourcePack::GetFileBuffer(const std::string& sFile)
-	{ return ResourceBuffer(baseFile, mapFiles[sFile].nOffset, mapFiles[sFile].nSize); }
+	{
+		auto it = mapFiles.find(sFile);
+		if (it == mapFiles.end() || pPackData == nullptr) return ResourceBuffer();
+		const sResourceFile& e = it->second;
+
+		// Files with no compressed blocks are viewed in place, a v2 file's blocks lie back to back
+		if (e.nBlocks == 0) return ResourceBuffer(pPackData + e.nOffset, e.nSize);
+		if (!e.bPacked) return ResourceBuffer(pPackData + vBlocks[e.nFirstBlock].nOffset, e.nSize);
+
+		std::unique_lock<std::mutex> lock(muxJobs);
+		sUnpackedFile* f = Unpack(sFile, e);
+
+		// Rather than sit idle until the file is ready, the caller works through the queue too
+		while (f->nBlocksLeft > 0)
+		{
+			if (!listJobs.empty())
+			{
+				auto job = std::move(listJobs.front());
+				listJobs.pop_front();
+				lock.unlock(); job(); lock.lock();
+			}
+			else
+				cvUnpacked.wait(lock);
+		}
+
+		if (f->bFailed) return ResourceBuffer();
+		return ResourceBuffer(f->vData.data(), f->vData.size());
+	}
+
+	void ResourcePack::Prefetch(const std::vector<std::string>& vFiles)
+	{
+		std::unique_lock<std::mutex> lock(muxJobs);
+		for (const auto& sFile : vFiles)
+		{
+			auto it = mapFiles.find(sFile);
+			if (it != mapFiles.end() && it->second.bPacked)
+				Unpack(sFile, it->second);
+		}
+	}
+
+	void ResourcePack::ReleaseFile(const std::string& sFile)
+	{
+		// A file still being unpacked is left alone, its blocks are in the workers' hands
+		std::unique_lock<std::mutex> lock(muxJobs);
+		auto it = mapUnpacked.find(sFile);
+		if (it != mapUnpacked.end() && it->second->nBlocksLeft == 0)
+			mapUnpacked.erase(it);
+	}
+
+	ResourcePack::sUnpackedFile* ResourcePack::Unpack(const std::string& sFile, const sResourceFile& e)
+	{
+		// Called with muxJobs held, queues a job per block unless the file is already unpacked or on its way
+		auto& unpacked = mapUnpacked[sFile];
+		if (unpacked) return unpacked.get();
+		unpacked = std::make_unique<sUnpackedFile>();
+		sUnpackedFile* f = unpacked.get();
+		f->vData.resize(e.nSize);
+		f->nBlocksLeft = e.nBlocks;
+
+		if (vWorkers.empty())
+		{
+			uint32_t nWorkers = std::max(2u, std::thread::hardware_concurrency()) - 1;
+			for (uint32_t i = 0; i < nWorkers; i++)
+				vWorkers.emplace_back(&ResourcePack::WorkerThread, this);
+		}
+
+		char* pDst = f->vData.data();
+		for (uint32_t i = 0; i < e.nBlocks; i++)
+		{
+			sResourceBlock b = vBlocks[e.nFirstBlock + i];
+			listJobs.push_back([this, f, b, pDst]()
+			{
+				bool bOk = true;
+				if (b.nPackedSize == b.nSize)
+					memcpy(pDst, pPackData + b.nOffset, b.nSize);
+				else
+					bOk = decompress(pPackData + b.nOffset, b.nPackedSize, pDst, b.nSize);
+
+				std::unique_lock<std::mutex> lock(muxJobs);
+				if (!bOk) f->bFailed = true;
+				if (--f->nBlocksLeft == 0) cvUnpacked.notify_all();
+			});
+			pDst += b.nSize;
+		}
+		cvJobs.notify_all();
+		return f;
+	}
+
+	void ResourcePack::WorkerThread()
+	{
+		std::unique_lock<std::mutex> lock(muxJobs);
+		while (true)
+		{
+			cvJobs.wait(lock, [this] { return bStopWorkers || !listJobs.empty(); });
+			// When stopping, whatever is queued still gets done
+			if (listJobs.empty()) return;
+			auto job = std::move(listJobs.front());
+			listJobs.pop_front();
+			lock.unlock(); job(); lock.lock();
+		}
+	}
+
+	void ResourcePack::StopWorkers()
+	{
+		{
+			std::unique_lock<std::mutex> lock(muxJobs);
+			bStopWorkers = true;
+		}
+		cvJobs.notify_all();
+		for (auto& t : vWorkers) t.join();
+		vWorkers.clear();
+		bStopWorkers = false;
+	}
+
+	bool ResourcePack::Contains(const std::string& sFile) const
+	{ return pPackData != nullptr && mapFiles.count(sFile) > 0; }
 
 	bool ResourcePack::Loaded()
-	{ return baseFile.is_open(); }
+	{ return pPackData != nullptr; }
 
 	std::vector<char> ResourcePack::scramble(const std::vector<char>& data, const std::string& key)
 	{
 		if (key.empty()) return data;
-		std::vector<char> o;
-		size_t c = 0;
-		for (auto s : data)	o.push_back(s ^ key[(c++) % key.size()]);
+		std::vector<char> o(data.size());
+		for (size_t i = 0, k = 0; i < data.size(); i++)
+		{
+			o[i] = data[i] ^ key[k];
+			if (++k == key.size()) k = 0;
+		}
 		return o;
 	};
 
@@ -1941,6 +2780,119 @@ namespace olc
 		return o;
 	};
 
+	// Compression is the LZ4 block format: runs of literal bytes, each followed by a
+	// match copied from up to 64KB back. It only squeezes out repeats, but unpacks about
+	// as fast as memory can be copied
+	std::vector<char> ResourcePack::compress(const char* data, size_t size)
+	{
+		const uint8_t* in = (const uint8_t*)data;
+		std::vector<char> out;
+		out.reserve(size + size / 255 + 16);
+		std::vector<int32_t> vTable(4096, -1); // Last position each hashed 4 byte sequence was seen
+
+		auto writeLength = [&out](size_t nLength)
+		{
+			for (; nLength >= 255; nLength -= 255) out.push_back(char(255));
+			out.push_back(char(nLength));
+		};
+
+		auto writeLiterals = [&](uint8_t nMatchNibble, size_t nStart, size_t nEnd)
+		{
+			size_t nLiterals = nEnd - nStart;
+			out.push_back(char((std::min<size_t>(nLiterals, 15) << 4) | nMatchNibble));
+			if (nLiterals >= 15) writeLength(nLiterals - 15);
+			out.insert(out.end(), data + nStart, data + nEnd);
+		};
+
+		// The format wants the last match to start 12 bytes before the end and stop 5 before
+		size_t nAnchor = 0, i = 0;
+		if (size > 12)
+		{
+			const size_t nMatchLimit = size - 12;
+			const size_t nMatchEnd = size - 5;
+			while (i < nMatchLimit)
+			{
+				uint32_t nSequence, nCandidate;
+				memcpy(&nSequence, in + i, 4);
+				uint32_t nHash = (nSequence * 2654435761u) >> 20;
+				int32_t nMatch = vTable[nHash];
+				vTable[nHash] = int32_t(i);
+
+				if (nMatch < 0 || i - nMatch > 65535 || (memcpy(&nCandidate, in + nMatch, 4), nCandidate != nSequence))
+				{
+					// Step faster through data that isn't matching, it likely won't compress
+					i += 1 + ((i - nAnchor) >> 6);
+					continue;
+				}
+
+				size_t nLength = 4;
+				while (i + nLength < nMatchEnd && in[nMatch + nLength] == in[i + nLength]) nLength++;
+
+				writeLiterals(uint8_t(std::min<size_t>(nLength - 4, 15)), nAnchor, i);
+				size_t nDistance = i - nMatch;
+				out.push_back(char(nDistance & 0xFF));
+				out.push_back(char(nDistance >> 8));
+				if (nLength - 4 >= 15) writeLength(nLength - 4 - 15);
+
+				i += nLength;
+				nAnchor = i;
+			}
+		}
+
+		// Whatever is left goes out as a last run of literals with no match
+		writeLiterals(0, nAnchor, size);
+		return out;
+	}
+
+	bool ResourcePack::decompress(const char* src, size_t srcSize, char* dst, size_t dstSize)
+	{
+		const uint8_t* ip = (const uint8_t*)src;
+		const uint8_t* ipEnd = ip + srcSize;
+		size_t op = 0;
+
+		// Returns size_t(-1) if the length runs off the end of the input
+		auto readLength = [&](size_t nLength) -> size_t
+		{
+			if (nLength != 15) return nLength;
+			uint8_t nByte;
+			do
+			{
+				if (ip >= ipEnd) return size_t(-1);
+				nByte = *ip++;
+				nLength += nByte;
+			} while (nByte == 255);
+			return nLength;
+		};
+
+		// Every length and distance is checked, a damaged block fails rather than writing out of bounds
+		while (ip < ipEnd)
+		{
+			uint8_t nToken = *ip++;
+			size_t nLiterals = readLength(nToken >> 4);
+			if (nLiterals > size_t(ipEnd - ip) || nLiterals > dstSize - op) return false;
+			memcpy(dst + op, ip, nLiterals);
+			ip += nLiterals; op += nLiterals;
+			if (ip == ipEnd) break; // The last run has no match
+
+			if (ipEnd - ip < 2) return false;
+			size_t nDistance = size_t(ip[0]) | (size_t(ip[1]) << 8);
+			ip += 2;
+			size_t nLength = readLength(nToken & 15);
+			if (nLength == size_t(-1)) return false;
+			nLength += 4;
+			if (nDistance == 0 || nDistance > op || nLength > dstSize - op) return false;
+
+			// A match may overlap what it's copying, repeating the last few bytes over and over
+			const char* pMatch = dst + op - nDistance;
+			if (nDistance >= nLength)
+				memcpy(dst + op, pMatch, nLength);
+			else
+				for (size_t k = 0; k < nLength; k++) dst[op + k] = pMatch[k];
+			op += nLength;
+		}
+		return op == dstSize;
+	}
+
 	// O------------------------------------------------------------------------------O
 	// | olc::PixelGameEngine IMPLEMENTATION                                          |
 	// O------------------------------------------------------------------------------O
@@ -2123,6 +3075,32 @@ namespace olc
 	float PixelGameEngine::GetElapsedTime() const
 	{ return fLastElapsed; }
 
+	void PixelGameEngine::SetFixedTimestep(float fStep, int32_t nMaxSteps)
+	{
+		fFixedTimestep = std::max(fStep, 0.0f);
+		nMaxFixedSteps = std::max(nMaxSteps, 1);
+		fFixedAccumulator = 0.0f;
+		fFixedAlpha = 0.0f;
+	}
+
+	float PixelGameEngine::GetFixedTimestep() const
+	{ return fFixedTimestep; }
+
+	float PixelGameEngine::GetFixedAlpha() const
+	{ return fFixedAlpha; }
+
+	void PixelGameEngine::SetFrameLimit(float fFrameTime, float fSpinTime)
+	{
+		fFrameLimit = std::max(fFrameTime, 0.0f);
+		fFrameLimitSpin = std::max(fSpinTime, 0.0f);
+	}
+
+	float PixelGameEngine::GetFrameLimit() const
+	{ return fFrameLimit; }
+
+	float PixelGameEngine::GetInputLatency() const
+	{ return fInputLatency; }
+
 	const olc::vi2d& PixelGameEngine::GetWindowSize() const
 	{ return vWindowSize; }
 
@@ -2359,9 +3337,10 @@ namespace olc
 
 	void PixelGameEngine::Clear(Pixel p)
 	{
-		int pixels = GetDrawTargetWidth() * GetDrawTargetHeight();
-		Pixel* m = GetDrawTarget()->GetData();
-		for (int i = 0; i < pixels; i++) m[i] = p;
+		// Targets bigger than a typical L2 are streamed, they would only evict the
+		// cache on their way through it (tiled targets have padding, so fill it all)
+		std::vector<olc::Pixel>& vData = GetDrawTarget()->pColData;
+		PixelFill(vData.data(), vData.size(), p, vData.size() * sizeof(olc::Pixel) >= nStreamFillBytes);
 	}
 
 	void PixelGameEngine::ClearBuffer(Pixel p, bool bDepth)
@@ -2427,8 +3406,17 @@ namespace olc
 		if (y2 < 0) y2 = 0;
 		if (y2 >= (int32_t)GetDrawTargetHeight()) y2 = (int32_t)GetDrawTargetHeight();
 
-		for (int i = x; i < x2; i++)
+		// An opaque colour in NORMAL or MASK mode is a plain store, so fill whole rows
+		if (pDrawTarget != nullptr && pDrawTarget->GetLayout() == olc::Sprite::Layout::LINEAR &&
+			(nPixelMode == Pixel::NORMAL || (nPixelMode == Pixel::MASK && p.a == 255)))
+		{
 			for (int j = y; j < y2; j++)
+				PixelFill(pDrawTarget->GetData() + size_t(j) * pDrawTarget->width + x, size_t(std::max(0, x2 - x)), p);
+			return;
+		}
+
+		for (int j = y; j < y2; j++)
+			for (int i = x; i < x2; i++)
 				Draw(i, j, p);
 	}
 
@@ -2583,6 +3571,18 @@ namespace olc
 
 	void PixelGameEngine::FillTexturedTriangle(std::vector<olc::vf2d> vPoints, std::vector<olc::vf2d> vTex, std::vector<olc::Pixel> vColour, olc::Sprite* sprTex)
 	{
+		// Texture mapping is affine, so the screen space UV derivatives are constant
+		// across the triangle and one mip level serves every pixel of it
+		float fLod = 0.0f;
+		if (sprTex != nullptr && sprTex->MipLevels() > 1)
+		{
+			olc::vf2d e1 = vPoints[1] - vPoints[0], e2 = vPoints[2] - vPoints[0];
+			olc::vf2d t1 = vTex[1] - vTex[0], t2 = vTex[2] - vTex[0];
+			float fDet = e1.x * e2.y - e2.x * e1.y;
+			if (fDet != 0.0f)
+				fLod = sprTex->MipLevelFor((t1 * e2.y - t2 * e1.y) / fDet, (t2 * e1.x - t1 * e2.x) / fDet);
+		}
+
 		olc::vi2d p1 = vPoints[0];
 		olc::vi2d p2 = vPoints[1];
 		olc::vi2d p3 = vPoints[2];
@@ -2686,7 +3686,7 @@ namespace olc
 					for (int j = ax; j < bx; j++)
 					{
 						olc::Pixel pixel = PixelLerp(col_s, col_e, t);
-						if (sprTex != nullptr) pixel *= sprTex->Sample(tex_s.lerp(tex_e, t));
+						if (sprTex != nullptr) pixel *= fLod > 0.0f ? sprTex->SampleTL(tex_s.lerp(tex_e, t), fLod) : sprTex->Sample(tex_s.lerp(tex_e, t));
 						Draw(j, i, pixel);
 						t += tstep;
 					}
@@ -2751,33 +3751,7 @@ namespace olc
 		if (sprite == nullptr)
 			return;
 
-		int32_t fxs = 0, fxm = 1, fx = 0;
-		int32_t fys = 0, fym = 1, fy = 0;
-		if (flip & olc::Sprite::Flip::HORIZ) { fxs = sprite->width - 1; fxm = -1; }
-		if (flip & olc::Sprite::Flip::VERT) { fys = sprite->height - 1; fym = -1; }
-
-		if (scale > 1)
-		{
-			fx = fxs;
-			for (int32_t i = 0; i < sprite->width; i++, fx += fxm)
-			{
-				fy = fys;
-				for (int32_t j = 0; j < sprite->height; j++, fy += fym)
-					for (uint32_t is = 0; is < scale; is++)
-						for (uint32_t js = 0; js < scale; js++)
-							Draw(x + (i * scale) + is, y + (j * scale) + js, sprite->GetPixel(fx, fy));
-			}
-		}
-		else
-		{
-			fx = fxs;
-			for (int32_t i = 0; i < sprite->width; i++, fx += fxm)
-			{
-				fy = fys;
-				for (int32_t j = 0; j < sprite->height; j++, fy += fym)
-					Draw(x + i, y + j, sprite->GetPixel(fx, fy));
-			}
-		}
+		DrawPartialSprite(x, y, sprite, 0, 0, sprite->width, sprite->height, scale, flip);
 	}
 
 	void PixelGameEngine::DrawPartialSprite(const olc::vi2d& pos, Sprite* sprite, const olc::vi2d& sourcepos, const olc::vi2d& size, uint32_t scale, uint8_t flip)
@@ -2788,6 +3762,9 @@ namespace olc
 		if (sprite == nullptr)
 			return;
 
+		if (BlitSprite(x, y, sprite, ox, oy, w, h, scale, flip))
+			return;
+
 		int32_t fxs = 0, fxm = 1, fx = 0;
 		int32_t fys = 0, fym = 1, fy = 0;
 		if (flip & olc::Sprite::Flip::HORIZ) { fxs = w - 1; fxm = -1; }
@@ -2795,28 +3772,138 @@ namespace olc
 
 		if (scale > 1)
 		{
-			fx = fxs;
-			for (int32_t i = 0; i < w; i++, fx += fxm)
-			{
-				fy = fys;
-				for (int32_t j = 0; j < h; j++, fy += fym)
-					for (uint32_t is = 0; is < scale; is++)
-						for (uint32_t js = 0; js < scale; js++)
+			fy = fys;
+			for (int32_t j = 0; j < h; j++, fy += fym)
+				for (uint32_t js = 0; js < scale; js++)
+				{
+					fx = fxs;
+					for (int32_t i = 0; i < w; i++, fx += fxm)
+						for (uint32_t is = 0; is < scale; is++)
 							Draw(x + (i * scale) + is, y + (j * scale) + js, sprite->GetPixel(fx + ox, fy + oy));
-			}
+				}
 		}
 		else
 		{
-			fx = fxs;
-			for (int32_t i = 0; i < w; i++, fx += fxm)
+			fy = fys;
+			for (int32_t j = 0; j < h; j++, fy += fym)
 			{
-				fy = fys;
-				for (int32_t j = 0; j < h; j++, fy += fym)
+				fx = fxs;
+				for (int32_t i = 0; i < w; i++, fx += fxm)
 					Draw(x + i, y + j, sprite->GetPixel(fx + ox, fy + oy));
 			}
 		}
 	}
 
+	bool PixelGameEngine::BlitSprite(int32_t x, int32_t y, olc::Sprite* sprite, int32_t ox, int32_t oy, int32_t w, int32_t h, uint32_t scale, uint8_t flip)
+	{
+		// Only row-major sources lying wholly inside the sprite qualify, anything else needs
+		// GetPixel()'s sample modes, Draw()'s custom callback or per pixel read-after-write
+		if (pDrawTarget == nullptr || pDrawTarget == sprite || nPixelMode == Pixel::CUSTOM) return false;
+		if (sprite->GetLayout() != olc::Sprite::Layout::LINEAR || pDrawTarget->GetLayout() != olc::Sprite::Layout::LINEAR) return false;
+		if (w <= 0 || h <= 0) return true;
+		if (ox < 0 || oy < 0 || ox + w > sprite->width || oy + h > sprite->height) return false;
+
+		// Clip the scaled destination rectangle to the draw target once, up front
+		int64_t nScale = std::max(uint32_t(1), scale);
+		int32_t x0 = std::max(0, x), y0 = std::max(0, y);
+		int32_t x1 = int32_t(std::min(int64_t(pDrawTarget->width), int64_t(x) + int64_t(w) * nScale));
+		int32_t y1 = int32_t(std::min(int64_t(pDrawTarget->height), int64_t(y) + int64_t(h) * nScale));
+		if (x0 >= x1 || y0 >= y1) return true;
+		int32_t nSpan = x1 - x0;
+
+		// Flipped or scaled rows are gathered through a column table built once per call,
+		// unflipped unscaled rows are read straight out of the sprite
+		bool bDirect = nScale == 1 && !(flip & olc::Sprite::Flip::HORIZ);
+		if (!bDirect)
+		{
+			vBlitColumns.resize(nSpan);
+			vBlitSpan.resize(nSpan);
+			for (int32_t k = 0; k < nSpan; k++)
+			{
+				int32_t c = int32_t((int64_t(x0) + k - x) / nScale);
+				vBlitColumns[k] = ox + ((flip & olc::Sprite::Flip::HORIZ) ? w - 1 - c : c);
+			}
+		}
+
+		int32_t nBlend = int32_t(std::max(0.0f, std::min(fBlendFactor, 1.0f)) * 256.0f + 0.5f);
+		const uint32_t nOpaque = 0xFF000000;
+		int32_t nLastRow = -1;
+		const olc::Pixel* pSpan = nullptr;
+
+		for (int32_t dy = y0; dy < y1; dy++)
+		{
+			int32_t r = int32_t((int64_t(dy) - y) / nScale);
+			if (flip & olc::Sprite::Flip::VERT) r = h - 1 - r;
+			const olc::Pixel* pRow = sprite->pColData.data() + size_t(oy + r) * sprite->width;
+
+			if (bDirect)
+				pSpan = pRow + ox + (x0 - x);
+			else if (r != nLastRow)
+			{
+				for (int32_t k = 0; k < nSpan; k++) vBlitSpan[k] = pRow[vBlitColumns[k]];
+				pSpan = vBlitSpan.data();
+				nLastRow = r;
+			}
+
+			const uint32_t* src = (const uint32_t*)pSpan;
+			uint32_t* dst = (uint32_t*)pDrawTarget->pColData.data() + size_t(dy) * pDrawTarget->width + x0;
+			int32_t i = 0;
+
+			if (nPixelMode == Pixel::NORMAL)
+			{
+				std::memcpy(dst, src, size_t(nSpan) * sizeof(uint32_t));
+			}
+			else if (nPixelMode == Pixel::MASK)
+			{
+#if defined(OLC_SIMD_SSE2)
+				__m128i vOpaque = _mm_set1_epi32(int32_t(nOpaque));
+				for (; i + 4 <= nSpan; i += 4)
+				{
+					__m128i s = _mm_loadu_si128((const __m128i*)(src + i)), d = _mm_loadu_si128((const __m128i*)(dst + i));
+					__m128i m = _mm_cmpeq_epi32(_mm_and_si128(s, vOpaque), vOpaque);
+					_mm_storeu_si128((__m128i*)(dst + i), _mm_or_si128(_mm_and_si128(m, s), _mm_andnot_si128(m, d)));
+				}
+#endif
+				for (; i < nSpan; i++)
+					dst[i] = ((src[i] & nOpaque) == nOpaque) ? src[i] : dst[i];
+			}
+			else
+			{
+				// Source alpha scaled to 0..256 so opaque pixels copy exactly, the blend
+				// factor folds into it and the result is always opaque like Draw()'s
+#if defined(OLC_SIMD_SSE2)
+				__m128i zero = _mm_setzero_si128(), v256 = _mm_set1_epi16(256), vRound = _mm_set1_epi16(128), vBlend = _mm_set1_epi16(int16_t(nBlend));
+				auto blend = [&](__m128i s, __m128i d)
+				{
+					__m128i a = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, _MM_SHUFFLE(3, 3, 3, 3)), _MM_SHUFFLE(3, 3, 3, 3));
+					a = _mm_add_epi16(a, _mm_srli_epi16(a, 7));
+					if (nBlend < 256) a = _mm_srli_epi16(_mm_mullo_epi16(a, vBlend), 8);
+					__m128i sum = _mm_add_epi16(_mm_add_epi16(_mm_mullo_epi16(s, a), _mm_mullo_epi16(d, _mm_sub_epi16(v256, a))), vRound);
+					return _mm_srli_epi16(sum, 8);
+				};
+				for (; i + 4 <= nSpan; i += 4)
+				{
+					__m128i s = _mm_loadu_si128((const __m128i*)(src + i)), d = _mm_loadu_si128((const __m128i*)(dst + i));
+					__m128i lo = blend(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero));
+					__m128i hi = blend(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero));
+					_mm_storeu_si128((__m128i*)(dst + i), _mm_or_si128(_mm_packus_epi16(lo, hi), _mm_set1_epi32(int32_t(nOpaque))));
+				}
+#endif
+				for (; i < nSpan; i++)
+				{
+					uint32_t a = src[i] >> 24;
+					a += a >> 7;
+					if (nBlend < 256) a = (a * uint32_t(nBlend)) >> 8;
+					uint32_t p = nOpaque;
+					for (int c = 0; c < 24; c += 8)
+						p |= ((((src[i] >> c) & 0xFF) * a + ((dst[i] >> c) & 0xFF) * (256 - a) + 128) >> 8) << c;
+					dst[i] = p;
+				}
+			}
+		}
+		return true;
+	}
+
 	void PixelGameEngine::SetDecalMode(const olc::DecalMode& mode)
 	{ nDecalMode = mode; }
 
@@ -3676,6 +4763,9 @@ namespace olc
 	bool PixelGameEngine::OnUserUpdate(float fElapsedTime)
 	{ UNUSED(fElapsedTime);  return false; }
 
+	bool PixelGameEngine::OnUserFixedUpdate(float fFixedTimestep)
+	{ UNUSED(fFixedTimestep); return true; }
+
 	bool PixelGameEngine::OnUserDestroy()
 	{ return true; }
 
@@ -3813,15 +4903,46 @@ namespace olc
 		vLayers[0].bShow = true;
 		SetDrawTarget(nullptr);
 
-		m_tp1 = std::chrono::system_clock::now();
-		m_tp2 = std::chrono::system_clock::now();
+		m_tp1 = std::chrono::steady_clock::now();
+		m_tp2 = std::chrono::steady_clock::now();
 	}
 
 
+	void PixelGameEngine::olc_WaitForFrameLimit()
+	{
+		if (fFrameLimit <= 0.0f) return;
+
+		// Frames are timed from the start of the last one, a frame that runs long is
+		// simply late rather than making the next ones hurry to catch up
+		auto tpTarget = m_tp1 + std::chrono::duration_cast<std::chrono::steady_clock::duration>(std::chrono::duration<float>(fFrameLimit));
+
+		// Sleep in short slices while the time left comfortably covers one, the estimate
+		// of how long a slice really takes rises at once and falls back slowly, so a
+		// scheduler that oversleeps now and then doesn't make the frame late. It decays
+		// every frame, even one that didn't sleep, and is capped at a quarter of the frame,
+		// so a coarse timer (~15ms on Windows) can't push the limiter into spinning forever
+		fSleepEstimate = std::min(fSleepEstimate * 0.95f, fFrameLimit * 0.25f);
+		while (true)
+		{
+			auto tpNow = std::chrono::steady_clock::now();
+			float fRemaining = std::chrono::duration<float>(tpTarget - tpNow).count();
+			if (fRemaining <= fSleepEstimate + fFrameLimitSpin) break;
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			float fSlept = std::chrono::duration<float>(std::chrono::steady_clock::now() - tpNow).count();
+			fSleepEstimate = std::min(fSlept > fSleepEstimate ? fSlept : fSleepEstimate * 0.95f + fSlept * 0.05f, fFrameLimit * 0.25f);
+		}
+
+		// Spin out the rest for an exact frame start
+		while (std::chrono::steady_clock::now() < tpTarget) {}
+	}
+
 	void PixelGameEngine::olc_CoreUpdate()
 	{
-		// Handle Timing
-		m_tp2 = std::chrono::system_clock::now();
+		// Wait out the frame limit before anything else, so input is read as late as possible
+		olc_WaitForFrameLimit();
+
+		// Handle Timing, on a steady clock so wall clock adjustments can't make time jump or run backwards
+		m_tp2 = std::chrono::steady_clock::now();
 		std::chrono::duration<float> elapsedTime = m_tp2 - m_tp1;
 		m_tp1 = m_tp2;
 
@@ -3834,6 +4955,7 @@ namespace olc
 
 		// Some platforms will need to check for events
 		platform->HandleSystemEvent();
+		m_tpInput = std::chrono::steady_clock::now();
 
 		// Compare hardware input states from previous frame
 		auto ScanHardware = [&](HWButton* pKeys, bool* pStateOld, bool* pStateNew, uint32_t nKeyCount)
@@ -3881,6 +5003,20 @@ namespace olc
 		for (auto& ext : vExtensions) bExtensionBlockFrame |= ext->OnBeforeUserUpdate(fElapsedTime);
 		if (!bExtensionBlockFrame)
 		{
+			if (fFixedTimestep > 0.0f)
+			{
+				fFixedAccumulator += fElapsedTime;
+				int32_t nSteps = 0;
+				while (fFixedAccumulator >= fFixedTimestep && nSteps < nMaxFixedSteps && bAtomActive)
+				{
+					if (!OnUserFixedUpdate(fFixedTimestep)) bAtomActive = false;
+					fFixedAccumulator -= fFixedTimestep;
+					nSteps++;
+				}
+				if (fFixedAccumulator >= fFixedTimestep) fFixedAccumulator = std::fmod(fFixedAccumulator, fFixedTimestep);
+				fFixedAlpha = fFixedAccumulator / fFixedTimestep;
+			}
+
 			if (!OnUserUpdate(fElapsedTime)) bAtomActive = false;
 			
 		}
@@ -3936,17 +5072,21 @@ namespace olc
 
 		// Present Graphics to screen
 		renderer->DisplayFrame();
+		fInputLatency = std::chrono::duration<float>(std::chrono::steady_clock::now() - m_tpInput).count();
 
 		// Update Title Bar
 		fFrameTimer += fElapsedTime;
+		fLatencyTotal += fInputLatency;
 		nFrameCount++;
 		if (fFrameTimer >= 1.0f)
 		{
 			nLastFPS = nFrameCount;
 			fFrameTimer -= 1.0f;
-			std::string sTitle = "OneLoneCoder.com - Pixel Game Engine - " + sAppName + " - FPS: " + std::to_string(nFrameCount);
+			std::string sTitle = "OneLoneCoder.com - Pixel Game Engine - " + sAppName + " - FPS: " + std::to_string(nFrameCount)
+				+ " - Latency: " + std::to_string((int)(fLatencyTotal * 1000.0f / nFrameCount)) + "ms";
 			platform->SetWindowTitle(sTitle);
 			nFrameCount = 0;
+			fLatencyTotal = 0.0f;
 		}
 	}
 
@@ -4133,20 +5273,32 @@ namespace olc
 			if (pack != nullptr)
 			{
 				ResourceBuffer rb = pack->GetFileBuffer(sImageFile);
-				bytes = stbi_load_from_memory((unsigned char*)rb.vMemory.data(), rb.vMemory.size(), &w, &h, &cmp, 4);
-			}
-			else
-			{
-				// Check file exists
-				if (!_gfs::exists(sImageFile)) return olc::rcode::NO_FILE;
-				bytes = stbi_load(sImageFile.c_str(), &w, &h, &cmp, 4);
+				if (!rb.Valid()) return olc::rcode::NO_FILE;
+				return LoadImageMemory(spr, rb.Data(), rb.Size());
 			}
 
+			// Check file exists
+			if (!_gfs::exists(sImageFile)) return olc::rcode::NO_FILE;
+			bytes = stbi_load(sImageFile.c_str(), &w, &h, &cmp, 4);
+			return TakePixels(spr, bytes, w, h);
+		}
+
+		olc::rcode LoadImageMemory(olc::Sprite* spr, const char* pData, size_t nSize) override
+		{
+			spr->pColData.clear();
+			int w = 0, h = 0, cmp = 0;
+			stbi_uc* bytes = stbi_load_from_memory((const stbi_uc*)pData, int(nSize), &w, &h, &cmp, 4);
+			return TakePixels(spr, bytes, w, h);
+		}
+
+		olc::rcode TakePixels(olc::Sprite* spr, stbi_uc* bytes, int w, int h)
+		{
 			if (!bytes) return olc::rcode::FAIL;
 			spr->width = w; spr->height = h;
-			spr->pColData.resize(spr->width * spr->height);
-			std::memcpy(spr->pColData.data(), bytes, spr->width * spr->height * 4);
-			delete[] bytes;
+			// Filled straight from stb's buffer, one pass rather than zeroing then copying over
+			const olc::Pixel* pixels = (const olc::Pixel*)bytes;
+			spr->pColData.assign(pixels, pixels + size_t(w) * h);
+			stbi_image_free(bytes);
 			return olc::rcode::OK;
 		}
 
@@ -5182,17 +6334,26 @@ namespace olc
 			{
 				// Load sprite from input stream
 				ResourceBuffer rb = pack->GetFileBuffer(sImageFile);
-				bmp = Gdiplus::Bitmap::FromStream(SHCreateMemStream((BYTE*)rb.vMemory.data(), UINT(rb.vMemory.size())));
+				if (!rb.Valid()) return olc::rcode::NO_FILE;
+				return LoadImageMemory(spr, rb.Data(), rb.Size());
 			}
-			else
-			{
-				// Check file exists
-				if (!_gfs::exists(sImageFile)) return olc::rcode::NO_FILE;
 
-				// Load sprite from file
-				bmp = Gdiplus::Bitmap::FromFile(ConvertS2W(sImageFile).c_str());
-			}
+			// Check file exists
+			if (!_gfs::exists(sImageFile)) return olc::rcode::NO_FILE;
+
+			// Load sprite from file
+			bmp = Gdiplus::Bitmap::FromFile(ConvertS2W(sImageFile).c_str());
+			return TakeBitmap(spr, bmp);
+		}
 
+		olc::rcode LoadImageMemory(olc::Sprite* spr, const char* pData, size_t nSize) override
+		{
+			spr->pColData.clear();
+			return TakeBitmap(spr, Gdiplus::Bitmap::FromStream(SHCreateMemStream((const BYTE*)pData, UINT(nSize))));
+		}
+
+		olc::rcode TakeBitmap(olc::Sprite* spr, Gdiplus::Bitmap* bmp)
+		{
 			if (bmp->GetLastStatus() != Gdiplus::Ok) return olc::rcode::FAIL;
 			spr->width = bmp->GetWidth();
 			spr->height = bmp->GetHeight();
@@ -5234,6 +6395,7 @@ namespace olc
 	{
 		png_voidp a = png_get_io_ptr(pngPtr);
 		((std::istream*)a)->read((char*)data, length);
+		if (size_t(((std::istream*)a)->gcount()) != length) png_error(pngPtr, "unexpected end of image data");
 	}
 
 	class ImageLoader_LibPNG : public olc::ImageLoader
@@ -5244,8 +6406,30 @@ namespace olc
 
 		olc::rcode LoadImageResource(olc::Sprite* spr, const std::string& sImageFile, olc::ResourcePack* pack) override
 		{
-			UNUSED(pack);
+			if (pack == nullptr)
+			{
+				FILE* f = fopen(sImageFile.c_str(), "rb");
+				if (!f) return olc::rcode::NO_FILE;
+				olc::rcode result = LoadPNG(spr, f, nullptr);
+				fclose(f);
+				return result;
+			}
 
+			ResourceBuffer rb = pack->GetFileBuffer(sImageFile);
+			if (!rb.Valid()) return olc::rcode::NO_FILE;
+			return LoadImageMemory(spr, rb.Data(), rb.Size());
+		}
+
+		olc::rcode LoadImageMemory(olc::Sprite* spr, const char* pData, size_t nSize) override
+		{
+			ResourceBuffer rb(pData, nSize);
+			std::istream is(&rb);
+			return LoadPNG(spr, nullptr, &is);
+		}
+
+		// Reads from f if it is set, otherwise from is
+		olc::rcode LoadPNG(olc::Sprite* spr, FILE* f, std::istream* is)
+		{
 			// clear out existing sprite
 			spr->pColData.clear();
 
@@ -5262,7 +6446,6 @@ namespace olc
 				png_read_info(png, info);
 				png_byte color_type;
 				png_byte bit_depth;
-				png_bytep* row_pointers;
 				spr->width = png_get_image_width(png, info);
 				spr->height = png_get_image_height(png, info);
 				color_type = png_get_color_type(png, info);
@@ -5276,27 +6459,15 @@ namespace olc
 				if (color_type == PNG_COLOR_TYPE_GRAY || color_type == PNG_COLOR_TYPE_GRAY_ALPHA)
 					png_set_gray_to_rgb(png);
 				png_read_update_info(png, info);
-				row_pointers = (png_bytep*)malloc(sizeof(png_bytep) * spr->height);
-				for (int y = 0; y < spr->height; y++) {
-					row_pointers[y] = (png_byte*)malloc(png_get_rowbytes(png, info));
-				}
-				png_read_image(png, row_pointers);
 				////////////////////////////////////////////////////////////////////////////
-				// Create sprite array
-				spr->pColData.resize(spr->width * spr->height);
-				// Iterate through image rows, converting into sprite format
+				// Decode straight into the sprite, the transforms above leave every row as
+				// RGBA bytes, which is the layout of olc::Pixel
+				if (png_get_rowbytes(png, info) != size_t(spr->width) * 4) png_error(png, "unexpected row layout");
+				spr->pColData.resize(size_t(spr->width) * spr->height);
+				png_bytep* row_pointers = (png_bytep*)malloc(sizeof(png_bytep) * spr->height);
 				for (int y = 0; y < spr->height; y++)
-				{
-					png_bytep row = row_pointers[y];
-					for (int x = 0; x < spr->width; x++)
-					{
-						png_bytep px = &(row[x * 4]);
-						spr->SetPixel(x, y, Pixel(px[0], px[1], px[2], px[3]));
-					}
-				}
-
-				for (int y = 0; y < spr->height; y++) // Thanks maksym33
-					free(row_pointers[y]);
+					row_pointers[y] = (png_bytep)(spr->pColData.data() + size_t(y) * spr->width);
+				png_read_image(png, row_pointers);
 				free(row_pointers);
 				png_destroy_read_struct(&png, &info, nullptr);
 			};
@@ -5309,21 +6480,11 @@ namespace olc
 
 			if (setjmp(png_jmpbuf(png))) goto fail_load;
 
-			if (pack == nullptr)
-			{
-				FILE* f = fopen(sImageFile.c_str(), "rb");
-				if (!f) return olc::rcode::NO_FILE;
+			if (f != nullptr)
 				png_init_io(png, f);
-				loadPNG();
-				fclose(f);
-			}
 			else
-			{
-				ResourceBuffer rb = pack->GetFileBuffer(sImageFile);
-				std::istream is(&rb);
-				png_set_read_fn(png, (png_voidp)&is, pngReadStream);
-				loadPNG();
-			}
+				png_set_read_fn(png, (png_voidp)is, pngReadStream);
+			loadPNG();
 
 			return olc::rcode::OK;
 